@@ -35,14 +35,35 @@
     'type': 'static_library',
     'sources': [
       'src/shared/AutoHandle.cpp',
+      'src/shared/BoundedQueue.h',
+      'src/shared/Channel.h',
+      'src/shared/Channel.cpp',
       'src/shared/Communication.cpp',
       'src/shared/Dictionary.cpp',
+      'src/shared/LoopbackTransport.h',
+      'src/shared/LoopbackTransport.cpp',
       'src/shared/Utils.cpp',
       'src/shared/Registry.h',
       'src/shared/Registry.cpp',
+      'src/shared/ShardedLruCache.h',
       'src/shared/IE_version.h',
       'src/shared/IE_version.cpp',
-      ]
+      ],
+    'conditions': [[
+      'OS=="win"',
+      {
+        'sources': [
+          'src/shared/NamedPipeTransport.h',
+          'src/shared/NamedPipeTransport.cpp',
+        ],
+      },
+      {
+        'sources': [
+          'src/shared/UnixSocketTransport.h',
+          'src/shared/UnixSocketTransport.cpp',
+        ],
+      },
+    ]],
   },
   
   {
@@ -55,6 +76,8 @@
     'sources': [
       'src/engine/Main.cpp',
       'src/engine/Debug.cpp',
+      'src/engine/Executor.h',
+      'src/engine/Executor.cpp',
       'src/engine/UpdateInstallDialog.cpp',
       'src/engine/Updater.cpp',
       'src/engine/engine.rc',
@@ -102,6 +125,8 @@
       'src/plugin/NotificationMessage.h',
       'src/plugin/Plugin.cpp',
       'src/plugin/Plugin.h',
+      'src/plugin/PluginAncestorFilter.cpp',
+      'src/plugin/PluginAncestorFilter.h',
       'src/plugin/PluginClass.cpp',
       'src/plugin/PluginClass.h',
       'src/plugin/PluginClient.h',
@@ -112,24 +137,41 @@
       'src/plugin/PluginDebug.cpp',
       'src/plugin/PluginDebug.h',
       'src/plugin/PluginDebugMacros.h',
+      'src/plugin/PluginDomMutationListener.cpp',
+      'src/plugin/PluginDomMutationListener.h',
       'src/plugin/PluginDomTraverserBase.h',
+      'src/plugin/PluginElementIdentityTable.cpp',
+      'src/plugin/PluginElementIdentityTable.h',
+      'src/plugin/PluginElementSnapshot.cpp',
+      'src/plugin/PluginElementSnapshot.h',
+      'src/plugin/PluginElementView.h',
       'src/plugin/PluginErrorCodes.h',
       'src/plugin/PluginFilter.cpp',
       'src/plugin/PluginFilter.h',
+      'src/plugin/PluginFilterElementHide.cpp',
+      'src/plugin/PluginFilterElementHide.h',
+      'src/plugin/PluginFilterIndex.cpp',
+      'src/plugin/PluginFilterIndex.h',
       'src/plugin/PluginMimeFilterClient.cpp',
       'src/plugin/PluginMimeFilterClient.h',
+      'src/plugin/PluginMshtmlElementView.cpp',
+      'src/plugin/PluginMshtmlElementView.h',
       'src/plugin/PluginMutex.cpp',
       'src/plugin/PluginMutex.h',
       'src/plugin/PluginPassthroughObject.h',
       'src/plugin/PluginSettings.cpp',
       'src/plugin/PluginSettings.h',
+      'src/plugin/PluginSlabArena.h',
       'src/plugin/PluginStdAfx.cpp',
       'src/plugin/PluginStdAfx.h',
+      'src/plugin/PluginStyleSheet.cpp',
+      'src/plugin/PluginStyleSheet.h',
       'src/plugin/PluginSystem.cpp',
       'src/plugin/PluginSystem.h',
       'src/plugin/PluginTab.h',
       'src/plugin/PluginTabBase.cpp',
       'src/plugin/PluginTabBase.h',
+      'src/plugin/PluginTreeWalker.h',
       'src/plugin/PluginTypedef.h',
       'src/plugin/PluginUserSettings.cpp',
       'src/plugin/PluginUserSettings.h',
@@ -207,9 +249,38 @@
       'libadblockplus/third_party/googletest.gyp:googletest_main',
     ],
     'sources': [
+      'src/engine/Debug.cpp',
+      'src/engine/Executor.cpp',
+      'test/BoundedQueueTest.cpp',
+      'test/ChannelTest.cpp',
       'test/CommunicationTest.cpp',
       'test/DictionaryTest.cpp',
+      'test/ExecutorTest.cpp',
       'test/RegistryTest.cpp',
+      'test/ShardedLruCacheTest.cpp',
+    ],
+    'defines': ['WINVER=0x0501'],
+    'link_settings': {
+      'libraries': ['-ladvapi32', '-lshell32', '-lole32'],
+    },
+    'msvs_settings': {
+      'VCLinkerTool': {
+        'SubSystem': '1',   # Console
+        'EntryPointSymbol': 'mainCRTStartup',
+      },
+    },
+  },
+
+  {
+    'target_name': 'benchmarks',
+    'type': 'executable',
+    'dependencies': [
+      'shared',
+      'libadblockplus/third_party/googletest.gyp:googletest_main',
+    ],
+    'sources': [
+      'test/benchmark/Benchmark.h',
+      'test/benchmark/CommunicationBenchmark.cpp',
     ],
     'defines': ['WINVER=0x0501'],
     'link_settings': {
@@ -231,8 +302,32 @@
       'libadblockplus/third_party/googletest.gyp:googletest_main',
     ],
     'sources': [
+      'src/plugin/PluginAncestorFilter.cpp',
+      'src/plugin/PluginAncestorFilter.h',
+      'src/plugin/PluginDocumentInventory.cpp',
+      'src/plugin/PluginDocumentInventory.h',
+      'src/plugin/PluginElementIdentityTable.cpp',
+      'src/plugin/PluginElementIdentityTable.h',
+      'src/plugin/PluginElementSnapshot.cpp',
+      'src/plugin/PluginElementSnapshot.h',
+      'src/plugin/PluginElementView.h',
+      'src/plugin/PluginFilterElementHide.cpp',
+      'src/plugin/PluginFilterElementHide.h',
+      'src/plugin/PluginFilterIndex.cpp',
+      'src/plugin/PluginFilterIndex.h',
+      'src/plugin/PluginSlabArena.h',
+      'src/plugin/PluginStyleSheet.cpp',
+      'src/plugin/PluginStyleSheet.h',
+      'src/plugin/PluginTreeWalker.h',
       'src/plugin/PluginUserSettings.cpp',
       'src/plugin/PluginUserSettings.h',
+      'test/plugin/ElementIdentityTableTest.cpp',
+      'test/plugin/FilterElementHideTest.cpp',
+      'test/plugin/FilterIndexTest.cpp',
+      'test/plugin/SlabArenaTest.cpp',
+      'test/plugin/SyntheticDom.cpp',
+      'test/plugin/SyntheticDom.h',
+      'test/plugin/TreeWalkerTest.cpp',
       'test/plugin/UserSettingsTest.cpp',
       #
       # required only for linking
@@ -247,8 +342,10 @@
       'src/plugin/PluginClientFactory.cpp',
       'src/plugin/PluginClass.cpp',
       'src/plugin/PluginDebug.cpp',
+      'src/plugin/PluginDomMutationListener.cpp',
       'src/plugin/PluginFilter.cpp',
       'src/plugin/PluginMimeFilterClient.cpp',
+      'src/plugin/PluginMshtmlElementView.cpp',
       'src/plugin/PluginMutex.cpp',
       'src/plugin/PluginSettings.cpp',
       'src/plugin/PluginSystem.cpp',
@@ -304,5 +401,41 @@
         },
       },
     },
+  },
+
+  {
+    'target_name': 'benchmarks_plugin',
+    'type': 'executable',
+    'dependencies': [
+      'libadblockplus/third_party/googletest.gyp:googletest_main',
+    ],
+    # Element hiding only, doesn't depend on ATL or MSHTML
+    'sources': [
+      'src/plugin/PluginAncestorFilter.cpp',
+      'src/plugin/PluginAncestorFilter.h',
+      'src/plugin/PluginDocumentInventory.cpp',
+      'src/plugin/PluginDocumentInventory.h',
+      'src/plugin/PluginElementSnapshot.cpp',
+      'src/plugin/PluginElementSnapshot.h',
+      'src/plugin/PluginElementView.h',
+      'src/plugin/PluginFilterElementHide.cpp',
+      'src/plugin/PluginFilterElementHide.h',
+      'src/plugin/PluginFilterIndex.cpp',
+      'src/plugin/PluginFilterIndex.h',
+      'src/plugin/PluginStyleSheet.cpp',
+      'src/plugin/PluginStyleSheet.h',
+      'src/plugin/PluginTreeWalker.h',
+      'test/benchmark/Benchmark.h',
+      'test/benchmark/ElementHidingBenchmark.cpp',
+      'test/benchmark/TraversalBenchmark.cpp',
+      'test/plugin/SyntheticDom.cpp',
+      'test/plugin/SyntheticDom.h',
+    ],
+    'msvs_settings': {
+      'VCLinkerTool': {
+        'SubSystem': '1',   # Console
+        'EntryPointSymbol': 'mainCRTStartup',
+      },
+    },
   }]
 }
@@ -0,0 +1,126 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+
+#include "Debug.h"
+#include "Executor.h"
+
+namespace
+{
+  LONGLONG GetTicks()
+  {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+  }
+
+  double TicksToMilliseconds(int64_t ticks)
+  {
+    LARGE_INTEGER frequency;
+    QueryPerformanceFrequency(&frequency);
+    return 1000.0 * ticks / frequency.QuadPart;
+  }
+
+  void UpdateMax(std::atomic<int64_t>& max, int64_t value)
+  {
+    int64_t current = max.load();
+    while (value > current && !max.compare_exchange_weak(current, value))
+      ;
+  }
+}
+
+Executor::Executor(const std::string& name, int threadCount, size_t capacity, Handler handler)
+  : name(name), handler(handler), queue(capacity),
+    submitted(0), maxDepth(0), totalWait(0), maxWait(0), totalSubmitBlocked(0)
+{
+  for (int i = 0; i < threadCount; i++)
+    threads.push_back(std::thread(std::bind(&Executor::Run, this)));
+}
+
+Executor::~Executor()
+{
+  queue.Close();
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+}
+
+void Executor::Submit(Request&& request)
+{
+  LONGLONG start = GetTicks();
+  request.queuedAt = start;
+  if (!queue.Push(std::move(request)))
+    return;
+
+  submitted++;
+  totalSubmitBlocked += GetTicks() - start;
+  UpdateMax(maxDepth, static_cast<int64_t>(queue.Size()));
+}
+
+std::string Executor::GetStatistics() const
+{
+  int64_t count = submitted;
+  std::stringstream stream;
+  stream << name << ": " << count << " requests, max queue depth " << maxDepth
+         << ", average wait " << (count ? TicksToMilliseconds(totalWait) / count : 0) << " ms"
+         << ", max wait " << TicksToMilliseconds(maxWait) << " ms"
+         << ", blocked submitting " << TicksToMilliseconds(totalSubmitBlocked) << " ms";
+  return stream.str();
+}
+
+void Executor::Run()
+{
+  Request request;
+  Communication::OutputBuffer response;
+  while (queue.Pop(request))
+  {
+    int64_t wait = GetTicks() - request.queuedAt;
+    totalWait += wait;
+    UpdateMax(maxWait, wait);
+
+    response.Clear();
+    try
+    {
+      response << true;
+      handler(request.procedure, request.message, response);
+    }
+    catch (const std::exception& e)
+    {
+      DebugException(e);
+      // Drops whatever the handler wrote, the client only gets the failure
+      response.Clear();
+      response << false;
+    }
+
+    try
+    {
+      response.SetRequestId(request.message.GetRequestId());
+      CriticalSection::Lock lock(request.connection->writeLock);
+      request.connection->pipe->WriteMessage(response);
+    }
+    catch (const Communication::PipeDisconnectedError&)
+    {
+    }
+    catch (const std::exception& e)
+    {
+      DebugException(e);
+    }
+
+    // Don't keep the connection alive while waiting for the next request
+    request.connection.reset();
+  }
+}
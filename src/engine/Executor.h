@@ -0,0 +1,107 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <Windows.h>
+
+#include "../shared/BoundedQueue.h"
+#include "../shared/Communication.h"
+#include "../shared/CriticalSection.h"
+
+// A connected client. Responses are written by whichever worker thread
+// handled the request, so writes have to be serialized.
+struct Connection
+{
+  std::shared_ptr<Communication::Pipe> pipe;
+  CriticalSection writeLock;
+
+  explicit Connection(std::shared_ptr<Communication::Pipe> pipe) : pipe(pipe) {}
+};
+
+struct Request
+{
+  std::shared_ptr<Connection> connection;
+  Communication::ProcType procedure;
+  Communication::InputBuffer message;
+  LONGLONG queuedAt;
+
+  Request() : procedure(Communication::PROC_MATCHES), queuedAt(0) {}
+  Request(Request&& other)
+    : connection(std::move(other.connection)), procedure(other.procedure),
+      message(std::move(other.message)), queuedAt(other.queuedAt)
+  {
+  }
+  Request& operator=(Request&& other)
+  {
+    connection = std::move(other.connection);
+    procedure = other.procedure;
+    message = std::move(other.message);
+    queuedAt = other.queuedAt;
+    return *this;
+  }
+
+private:
+  Request(const Request&);
+  Request& operator=(const Request&);
+};
+
+// Fixed number of worker threads taking requests from a bounded queue and
+// writing the responses back to the requesting connection. Each response
+// starts with a status: true followed by the values the handler wrote, or
+// just false if the handler threw.
+class Executor
+{
+public:
+  typedef std::function<void(Communication::ProcType, Communication::InputBuffer&,
+      Communication::OutputBuffer&)> Handler;
+
+  Executor(const std::string& name, int threadCount, size_t capacity, Handler handler);
+  ~Executor();
+
+  // Blocks while the queue is full, the connection's I/O thread then stops
+  // reading and the client is slowed down.
+  void Submit(Request&& request);
+  std::string GetStatistics() const;
+
+private:
+  std::string name;
+  Handler handler;
+  BoundedQueue<Request> queue;
+  std::vector<std::thread> threads;
+
+  // All times are in performance counter ticks
+  std::atomic<int64_t> submitted;
+  std::atomic<int64_t> maxDepth;
+  std::atomic<int64_t> totalWait;
+  std::atomic<int64_t> maxWait;
+  std::atomic<int64_t> totalSubmitBlocked;
+
+  void Run();
+
+  Executor(const Executor&);
+  Executor& operator=(const Executor&);
+};
+
+#endif
@@ -16,7 +16,9 @@
  */
 
 #include <AdblockPlus.h>
+#include <atomic>
 #include <functional>
+#include <unordered_set>
 #include <vector>
 #include <thread>
 #include <Windows.h>
@@ -28,14 +30,23 @@
 #include "../shared/Version.h"
 #include "../shared/CriticalSection.h"
 #include "../shared/IE_version.h"
+#include "../shared/ShardedLruCache.h"
 #include "AdblockPlus.h"
 #include "Debug.h"
+#include "Executor.h"
 #include "Updater.h"
 
 namespace
 {
   std::auto_ptr<AdblockPlus::FilterEngine> filterEngine;
   std::auto_ptr<Updater> updater;
+  // Cheap calls that block network requests get their own threads, so that
+  // they never wait behind slow calls like subscription updates.
+  std::auto_ptr<Executor> matcher;
+  std::auto_ptr<Executor> workers;
+  const int matcherThreads = 2;
+  const int workerThreads = 4;
+  const size_t queueCapacity = 256;
   int activeConnections = 0;
   CriticalSection activeConnectionsLock;
   HWND callbackWindow;
@@ -95,12 +106,172 @@ namespace
   CriticalSection updateCheckLock;
   bool firstRunActionExecuted = false;
   AdblockPlus::ReferrerMapping referrerMapping;
-  Communication::OutputBuffer HandleRequest(Communication::InputBuffer& request)
+  CriticalSection referrerMappingLock;
+
+  // Requests are handled on several threads, the mapping isn't thread-safe
+  std::vector<std::string> AddReferrer(const std::string& url, const std::string& documentUrl)
+  {
+    CriticalSection::Lock lock(referrerMappingLock);
+    referrerMapping.Add(url, documentUrl);
+    return referrerMapping.BuildReferrerChain(documentUrl);
+  }
+
+  struct MatchCacheKey
+  {
+    std::string url;
+    std::string type;
+    size_t referrerChainHash;
+    size_t hash;
+
+    MatchCacheKey(const std::string& url, const std::string& type, const std::vector<std::string>& referrerChain)
+      : url(url), type(type), referrerChainHash(0)
+    {
+      std::hash<std::string> hasher;
+      for (size_t i = 0; i < referrerChain.size(); i++)
+        referrerChainHash = referrerChainHash * 31 + hasher(referrerChain[i]);
+      hash = (hasher(url) * 31 + hasher(type)) * 31 + referrerChainHash;
+    }
+
+    bool operator==(const MatchCacheKey& other) const
+    {
+      return hash == other.hash && referrerChainHash == other.referrerChainHash &&
+          url == other.url && type == other.type;
+    }
+  };
+
+  struct MatchCacheKeyHash
+  {
+    size_t operator()(const MatchCacheKey& key) const
+    {
+      return key.hash;
+    }
+  };
+
+  // The same resources, trackers in particular, are requested on many pages
+  // and in many tabs. Invalidated whenever the filters change.
+  ShardedLruCache<MatchCacheKey, bool, MatchCacheKeyHash> matchCache(32768);
+
+  // Encoded PROC_GET_ELEMHIDE_SELECTORS responses by domain. With the
+  // generic selectors included they are large, so only few are kept.
+  ShardedLruCache<std::string, std::shared_ptr<Communication::OutputBuffer> > selectorCache(32, 4);
+
+  // Encoded PROC_GET_ELEMHIDE_SELECTORS_DELTA responses by domain, these are
+  // small.
+  ShardedLruCache<std::string, std::shared_ptr<Communication::OutputBuffer> > selectorDeltaCache(1024);
+
+  // Incremented whenever the filters change, clients use it to tell whether
+  // their copy of the generic selectors is still current.
+  std::atomic<uint32_t> filterGeneration(0);
+
+  void InvalidateCaches()
+  {
+    filterGeneration++;
+    matchCache.Invalidate();
+    selectorCache.Invalidate();
+    selectorDeltaCache.Invalidate();
+  }
+
+  // Selectors that apply on all domains, unless a domain is excluded
+  struct GenericSelectors
+  {
+    uint32_t generation;
+    std::unordered_set<std::string> selectors;
+    // PROC_GET_GENERIC_ELEMHIDE_SELECTORS response
+    Communication::OutputBuffer encoded;
+  };
+
+  std::shared_ptr<GenericSelectors> genericSelectors;
+  CriticalSection genericSelectorsLock;
+
+  std::shared_ptr<GenericSelectors> GetGenericSelectors()
   {
-    Communication::OutputBuffer response;
+    CriticalSection::Lock lock(genericSelectorsLock);
+    uint32_t generation = filterGeneration;
+    if (!genericSelectors || genericSelectors->generation != generation)
+    {
+      std::shared_ptr<GenericSelectors> result = std::make_shared<GenericSelectors>();
+      result->generation = generation;
+      // Without a domain, the filter engine only returns selectors that aren't
+      // restricted to particular domains.
+      std::vector<std::string> selectors = filterEngine->GetElementHidingSelectors("");
+      result->selectors.insert(selectors.begin(), selectors.end());
+      result->encoded << static_cast<int32_t>(generation);
+      WriteStrings(result->encoded, selectors);
+      genericSelectors = result;
+    }
+    return genericSelectors;
+  }
 
-    Communication::ProcType procedure;
-    request >> procedure;
+  // Encodes what a domain needs in addition to the generic selectors: its
+  // specific selectors and the generic selectors that don't apply there.
+  std::shared_ptr<Communication::OutputBuffer> GetSelectorDelta(const std::string& domain)
+  {
+    std::shared_ptr<Communication::OutputBuffer> delta;
+    if (selectorDeltaCache.Get(domain, delta))
+      return delta;
+
+    uint32_t cacheGeneration = selectorDeltaCache.GetGeneration();
+    std::shared_ptr<GenericSelectors> generic = GetGenericSelectors();
+    std::vector<std::string> selectors = filterEngine->GetElementHidingSelectors(domain);
+    std::unordered_set<std::string> applicable(selectors.begin(), selectors.end());
+
+    std::vector<std::string> specific;
+    for (size_t i = 0; i < selectors.size(); i++)
+    {
+      if (!generic->selectors.count(selectors[i]))
+        specific.push_back(selectors[i]);
+    }
+    std::vector<std::string> excluded;
+    for (auto it = generic->selectors.begin(); it != generic->selectors.end(); ++it)
+    {
+      if (!applicable.count(*it))
+        excluded.push_back(*it);
+    }
+
+    delta = std::make_shared<Communication::OutputBuffer>();
+    *delta << static_cast<int32_t>(generic->generation);
+    WriteStrings(*delta, specific);
+    WriteStrings(*delta, excluded);
+    selectorDeltaCache.Put(domain, delta, cacheGeneration);
+    return delta;
+  }
+
+  void OnFilterChange(const std::string& action, AdblockPlus::JsValuePtr item)
+  {
+    // Hit statistics change on every match but don't affect any results
+    if (action == "filter.hitCount" || action == "filter.lastHit")
+      return;
+    InvalidateCaches();
+  }
+
+  bool ShouldBlock(const std::string& url, const std::string& type, const std::string& documentUrl)
+  {
+    std::vector<std::string> referrerChain = AddReferrer(url, documentUrl);
+    MatchCacheKey key(url, type, referrerChain);
+    bool isBlocked;
+    if (matchCache.Get(key, isBlocked))
+      return isBlocked;
+
+    uint32_t generation = matchCache.GetGeneration();
+    AdblockPlus::FilterPtr filter = filterEngine->Matches(url, type, referrerChain);
+    isBlocked = filter && filter->GetType() != AdblockPlus::Filter::TYPE_EXCEPTION;
+    matchCache.Put(key, isBlocked, generation);
+    return isBlocked;
+  }
+
+  template<class Cache>
+  std::string GetCacheStatistics(const std::string& name, const Cache& cache)
+  {
+    int64_t hits = cache.GetHits();
+    int64_t lookups = hits + cache.GetMisses();
+    std::stringstream stream;
+    stream << name << ": " << hits << " hits in " << lookups << " lookups ("
+           << (lookups ? 100.0 * hits / lookups : 0) << "% hit rate)";
+    return stream.str();
+  }
+
+  void HandleRequest(Communication::ProcType procedure, Communication::InputBuffer& request, Communication::OutputBuffer& response)
+  {
     switch (procedure)
     {
       case Communication::PROC_MATCHES:
@@ -109,16 +280,69 @@ namespace
         std::string type;
         std::string documentUrl;
         request >> url >> type >> documentUrl;
-        referrerMapping.Add(url, documentUrl); 
-        AdblockPlus::FilterPtr filter = filterEngine->Matches(url, type, referrerMapping.BuildReferrerChain(documentUrl));
-        response << (filter && filter->GetType() != AdblockPlus::Filter::TYPE_EXCEPTION);
+
+        // Read before matching, a filter change while matching then shows up
+        // with the next response
+        int32_t generation = static_cast<int32_t>(filterGeneration);
+        bool isBlocked = ShouldBlock(url, type, documentUrl);
+        response << generation << isBlocked;
+        break;
+      }
+      case Communication::PROC_MATCHES_BATCH:
+      {
+        int32_t count;
+        request >> count;
+
+        // Each request takes at least the type and length of three strings
+        const size_t minRequestSize = 3 * 2 * sizeof(uint32_t);
+        if (count < 0 || static_cast<size_t>(count) > request.GetRemainingSize() / minRequestSize)
+          throw std::runtime_error("Invalid number of match requests");
+
+        // Verdicts are packed into a bit vector, bit i of word i / 32 is set
+        // if the i-th request should be blocked.
+        std::vector<uint32_t> verdicts((static_cast<size_t>(count) + 31) / 32, 0);
+        int32_t generation = static_cast<int32_t>(filterGeneration);
+        for (int32_t i = 0; i < count; i++)
+        {
+          std::string url;
+          std::string type;
+          std::string documentUrl;
+          request >> url >> type >> documentUrl;
+          if (ShouldBlock(url, type, documentUrl))
+            verdicts[i / 32] |= 1u << (i % 32);
+        }
+
+        response << generation << count;
+        for (size_t i = 0; i < verdicts.size(); i++)
+          response << static_cast<int32_t>(verdicts[i]);
         break;
       }
       case Communication::PROC_GET_ELEMHIDE_SELECTORS:
       {
         std::string domain;
         request >> domain;
-        WriteStrings(response, filterEngine->GetElementHidingSelectors(domain));
+
+        std::shared_ptr<Communication::OutputBuffer> selectors;
+        if (!selectorCache.Get(domain, selectors))
+        {
+          uint32_t generation = selectorCache.GetGeneration();
+          selectors = std::make_shared<Communication::OutputBuffer>();
+          WriteStrings(*selectors, filterEngine->GetElementHidingSelectors(domain));
+          selectorCache.Put(domain, selectors, generation);
+        }
+        response.Append(*selectors);
+        break;
+      }
+      case Communication::PROC_GET_GENERIC_ELEMHIDE_SELECTORS:
+      {
+        response.Append(GetGenericSelectors()->encoded);
+        break;
+      }
+      case Communication::PROC_GET_ELEMHIDE_SELECTORS_DELTA:
+      {
+        std::string domain;
+        request >> domain;
+        response.Append(*GetSelectorDelta(domain));
         break;
       }
       case Communication::PROC_AVAILABLE_SUBSCRIPTIONS:
@@ -154,6 +378,7 @@ namespace
         }
 
         filterEngine->GetSubscription(url)->AddToList();
+        InvalidateCaches();
         break;
       }
       case Communication::PROC_ADD_SUBSCRIPTION:
@@ -162,6 +387,7 @@ namespace
         request >> url;
 
         filterEngine->GetSubscription(url)->AddToList();
+        InvalidateCaches();
         break;
       }
       case Communication::PROC_REMOVE_SUBSCRIPTION:
@@ -170,6 +396,7 @@ namespace
         request >> url;
 
         filterEngine->GetSubscription(url)->RemoveFromList();
+        InvalidateCaches();
         break;
       }
       case Communication::PROC_UPDATE_ALL_SUBSCRIPTIONS:
@@ -177,6 +404,7 @@ namespace
         std::vector<AdblockPlus::SubscriptionPtr> subscriptions = filterEngine->GetListedSubscriptions();
         for (size_t i = 0, count = subscriptions.size(); i < count; i++)
           subscriptions[i]->UpdateFilters();
+        InvalidateCaches();
         break;
       }
       case Communication::PROC_GET_EXCEPTION_DOMAINS:
@@ -228,6 +456,7 @@ namespace
         request >> text;
 
         filterEngine->GetFilter(text)->AddToList();
+        InvalidateCaches();
         break;
       }
       case Communication::PROC_REMOVE_FILTER:
@@ -235,6 +464,7 @@ namespace
         std::string text;
         request >> text;
         filterEngine->GetFilter(text)->RemoveFromList();
+        InvalidateCaches();
         break;
       }
       case Communication::PROC_SET_PREF:
@@ -367,10 +597,24 @@ namespace
         break;
       }
     }
-    return response;
   }
 
-  void ClientThread(Communication::Pipe* pipe)
+  bool IsMatcherCall(Communication::ProcType procedure)
+  {
+    switch (procedure)
+    {
+    case Communication::PROC_MATCHES:
+    case Communication::PROC_MATCHES_BATCH:
+    case Communication::PROC_GET_HOST:
+    case Communication::PROC_IS_WHITELISTED_URL:
+    case Communication::PROC_IS_ELEMHIDE_WHITELISTED_ON_URL:
+      return true;
+    default:
+      return false;
+    }
+  }
+
+  void ClientThread(const std::shared_ptr<Communication::Pipe>& pipe)
   {
     std::stringstream stream;
     stream << GetCurrentThreadId();
@@ -383,13 +627,20 @@ namespace
       activeConnections++;
     }
 
+    // This thread only reads requests, they are handled and answered by the
+    // executors. Responses can be sent in any order, the client matches them
+    // by request ID.
+    std::shared_ptr<Connection> connection = std::make_shared<Connection>(pipe);
     for (;;)
     {
       try
       {
-        Communication::InputBuffer message = pipe->ReadMessage();
-        Communication::OutputBuffer response = HandleRequest(message);
-        pipe->WriteMessage(response);
+        Request request;
+        request.connection = connection;
+        pipe->ReadMessage(request.message);
+        request.message >> request.procedure;
+        Executor* executor = IsMatcherCall(request.procedure) ? matcher.get() : workers.get();
+        executor->Submit(std::move(request));
       }
       catch (const Communication::PipeDisconnectedError&)
       {
@@ -403,6 +654,11 @@ namespace
     }
 
     Debug("Client disconnected " + threadString);
+    Debug(matcher->GetStatistics());
+    Debug(workers->GetStatistics());
+    Debug(GetCacheStatistics("Match cache", matchCache));
+    Debug(GetCacheStatistics("Selector cache", selectorCache));
+    Debug(GetCacheStatistics("Selector delta cache", selectorDeltaCache));
 
     {
       CriticalSection::Lock lock(activeConnectionsLock);
@@ -478,7 +734,10 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
   LocalFree(argv);
   Dictionary::Create(locale);
   filterEngine = CreateFilterEngine(locale);
+  filterEngine->SetFilterChangeCallback(&OnFilterChange);
   updater.reset(new Updater(filterEngine->GetJsEngine()));
+  matcher.reset(new Executor("Matcher", matcherThreads, queueCapacity, HandleRequest));
+  workers.reset(new Executor("Workers", workerThreads, queueCapacity, HandleRequest));
 
   for (;;)
   {
@@ -492,7 +751,7 @@ int WINAPI WinMain(HINSTANCE, HINSTANCE, LPSTR, int)
       // disposing all its stuff.
       std::thread([pipe]()
       {
-        ClientThread(pipe.get());
+        ClientThread(pipe);
       }).detach();
     }
     catch(const std::system_error& ex)
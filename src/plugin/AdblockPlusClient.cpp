@@ -167,7 +167,7 @@ namespace
 
 CAdblockPlusClient* CAdblockPlusClient::s_instance = NULL;
 
-CAdblockPlusClient::CAdblockPlusClient() : CPluginClientBase()
+CAdblockPlusClient::CAdblockPlusClient() : CPluginClientBase(), m_blockCache(BLOCK_CACHE_SIZE), m_filterGeneration(0), m_genericFilterGeneration(0)
 {
   m_filter = std::auto_ptr<CPluginFilter>(new CPluginFilter());
 }
@@ -175,13 +175,25 @@ CAdblockPlusClient::CAdblockPlusClient() : CPluginClientBase()
 bool CAdblockPlusClient::CallEngine(Communication::OutputBuffer& message, Communication::InputBuffer& inputBuffer)
 {
   DEBUG_GENERAL("CallEngine start");
-  CriticalSection::Lock lock(enginePipeLock);
+  std::shared_ptr<Communication::Channel> channel;
   try
   {
-    if (!enginePipe)
-      enginePipe.reset(OpenEnginePipe());
-    enginePipe->WriteMessage(message);
-    inputBuffer = enginePipe->ReadMessage();
+    {
+      CriticalSection::Lock lock(enginePipeLock);
+      if (!engineChannel || !engineChannel->IsConnected())
+        engineChannel.reset(new Communication::Channel(std::unique_ptr<Communication::Pipe>(OpenEnginePipe())));
+      channel = engineChannel;
+    }
+    channel->Call(message, inputBuffer);
+
+    // The engine answers with false if handling the call failed, see Executor
+    bool success;
+    inputBuffer >> success;
+    if (!success)
+    {
+      DEBUG_GENERAL("CallEngine failed");
+      return false;
+    }
   }
   catch (const std::exception& e)
   {
@@ -199,8 +211,21 @@ bool CAdblockPlusClient::CallEngine(Communication::ProcType proc, Communication:
   return CallEngine(message, inputBuffer);
 }
 
+void CAdblockPlusClient::UpdateFilterGeneration(int32_t generation)
+{
+  if (m_filterGeneration.exchange(generation) != generation)
+  {
+    m_blockCache.Invalidate();
+  }
+}
+
 CAdblockPlusClient::~CAdblockPlusClient()
 {
+#if (defined ENABLE_DEBUG_INFO && defined ENABLE_DEBUG_GENERAL)
+  std::wstringstream stats;
+  stats << L"Block cache: " << m_blockCache.GetHits() << L" hits, " << m_blockCache.GetMisses() << L" misses";
+  DEBUG_GENERAL(stats.str().c_str());
+#endif
   s_instance = NULL;
 }
 
@@ -228,49 +253,66 @@ CAdblockPlusClient* CAdblockPlusClient::GetInstance()
 bool CAdblockPlusClient::ShouldBlock(const std::wstring& src, int contentType, const std::wstring& domain, bool addDebug)
 {
   bool isBlocked = false;
-  bool isCached = false;
-  m_criticalSectionCache.Lock();
+  BlockCacheKey key(src, contentType, domain);
+  if (!m_blockCache.Get(key, isBlocked))
   {
-    auto it = m_cacheBlockedSources.find(src);
+    uint32_t generation = m_blockCache.GetGeneration();
+    isBlocked = m_filter->ShouldBlock(src, contentType, domain, addDebug);
 
-    isCached = it != m_cacheBlockedSources.end();
-    if (isCached)
+    // Cache result, if content type is defined
+    if (contentType != CFilter::contentTypeAny)
     {
-      isBlocked = it->second;
+      m_blockCache.Put(key, isBlocked, generation);
     }
   }
-  m_criticalSectionCache.Unlock();
+  return isBlocked;
+}
 
-  if (!isCached)
+std::vector<bool> CAdblockPlusClient::ShouldBlock(const std::vector<SourceDescription>& sources, const std::wstring& domain)
+{
+  std::vector<bool> result(sources.size(), false);
+  std::vector<SourceDescription> uncachedSources;
+  std::vector<size_t> uncachedIndices;
+  for (size_t i = 0; i < sources.size(); i++)
   {
-    m_criticalSectionFilter.Lock();
+    bool isBlocked;
+    if (m_blockCache.Get(BlockCacheKey(sources[i].src, sources[i].contentType, domain), isBlocked))
     {
-      isBlocked = m_filter->ShouldBlock(src, contentType, domain, addDebug);
+      result[i] = isBlocked;
     }
-    m_criticalSectionFilter.Unlock();
+    else
+    {
+      uncachedSources.push_back(sources[i]);
+      uncachedIndices.push_back(i);
+    }
+  }
+
+  if (uncachedSources.empty())
+  {
+    return result;
+  }
+
+  uint32_t generation = m_blockCache.GetGeneration();
+  std::vector<bool> isBlocked = m_filter->ShouldBlock(uncachedSources, domain);
+
+  for (size_t i = 0; i < uncachedSources.size(); i++)
+  {
+    result[uncachedIndices[i]] = isBlocked[i];
 
     // Cache result, if content type is defined
-    if (contentType != CFilter::contentTypeAny)
+    if (uncachedSources[i].contentType != CFilter::contentTypeAny)
     {
-      m_criticalSectionCache.Lock();
-      {
-        m_cacheBlockedSources[src] = isBlocked;
-      }
-      m_criticalSectionCache.Unlock();
+      m_blockCache.Put(BlockCacheKey(uncachedSources[i].src, uncachedSources[i].contentType, domain), isBlocked[i], generation);
     }
   }
-  return isBlocked;
+  return result;
 }
 
-bool CAdblockPlusClient::IsElementHidden(const std::wstring& tag, IHTMLElement* pEl, const std::wstring& domain, const std::wstring& indent, CPluginFilter* filter)
+bool CAdblockPlusClient::IsElementHidden(const ElementSnapshot& element, const AncestorFilter& ancestors, const CPluginFilter::DocumentRules* rules,
+  const std::wstring& domain, const std::wstring& indent, CPluginFilter* filter)
 {
-  bool isHidden;
-  m_criticalSectionFilter.Lock();
-  {
-    isHidden = filter && filter->IsElementHidden(tag, pEl, domain, indent);
-  }
-  m_criticalSectionFilter.Unlock();
-  return isHidden;
+  // The filter looks up in an immutable snapshot, no lock needed
+  return filter && filter->IsElementHidden(element, &ancestors, rules, domain, indent);
 }
 
 bool CAdblockPlusClient::IsWhitelistedUrl(const std::wstring& url)
@@ -313,11 +355,46 @@ bool CAdblockPlusClient::Matches(const std::wstring& url, const std::wstring& co
   if (!CallEngine(request, response)) 
     return false;
 
+  int32_t generation;
   bool match;
-  response >> match;
+  response >> generation >> match;
+  UpdateFilterGeneration(generation);
   return match;
 }
 
+std::vector<bool> CAdblockPlusClient::Matches(const std::vector<MatchRequest>& requests)
+{
+  std::vector<bool> result(requests.size(), false);
+  if (requests.empty())
+    return result;
+
+  Communication::OutputBuffer request;
+  request << Communication::PROC_MATCHES_BATCH << static_cast<int32_t>(requests.size());
+  for (auto it = requests.begin(); it != requests.end(); ++it)
+    request << ToUtf8String(it->url) << ToUtf8String(it->contentType) << ToUtf8String(it->domain);
+
+  Communication::InputBuffer response;
+  if (!CallEngine(request, response))
+    return result;
+
+  int32_t generation;
+  int32_t count;
+  response >> generation >> count;
+  UpdateFilterGeneration(generation);
+  for (int32_t word = 0; word < (count + 31) / 32; word++)
+  {
+    int32_t packedVerdicts;
+    response >> packedVerdicts;
+    uint32_t verdicts = static_cast<uint32_t>(packedVerdicts);
+    for (int32_t i = word * 32; i < count && i < (word + 1) * 32; i++)
+    {
+      if (static_cast<size_t>(i) < result.size())
+        result[i] = (verdicts & (1u << (i % 32))) != 0;
+    }
+  }
+  return result;
+}
+
 std::vector<std::wstring> CAdblockPlusClient::GetElementHidingSelectors(const std::wstring& domain)
 {
   Communication::OutputBuffer request;
@@ -329,6 +406,49 @@ std::vector<std::wstring> CAdblockPlusClient::GetElementHidingSelectors(const st
   return ReadStrings(response);
 }
 
+bool CAdblockPlusClient::GetElementHidingSelectorsDelta(const std::wstring& domain, int32_t& generation,
+    std::vector<std::wstring>& selectors, std::vector<std::wstring>& excludedSelectors)
+{
+  Communication::OutputBuffer request;
+  request << Communication::PROC_GET_ELEMHIDE_SELECTORS_DELTA << ToUtf8String(domain);
+
+  Communication::InputBuffer response;
+  if (!CallEngine(request, response))
+    return false;
+  response >> generation;
+  UpdateFilterGeneration(generation);
+  selectors = ReadStrings(response);
+  excludedSelectors = ReadStrings(response);
+  return true;
+}
+
+std::shared_ptr<const CPluginFilter> CAdblockPlusClient::GetGenericFilter(int32_t generation)
+{
+  // Tabs navigating at the same time wait here instead of all fetching the
+  // same selectors.
+  CriticalSection::Lock lock(m_genericFilterLock);
+  if (m_genericFilter && m_genericFilterGeneration == generation)
+    return m_genericFilter;
+
+  Communication::InputBuffer response;
+  if (!CallEngine(Communication::PROC_GET_GENERIC_ELEMHIDE_SELECTORS, response))
+    return std::shared_ptr<const CPluginFilter>();
+
+  int32_t currentGeneration;
+  response >> currentGeneration;
+  UpdateFilterGeneration(currentGeneration);
+  std::shared_ptr<CPluginFilter> filter(new CPluginFilter());
+  filter->LoadHideFilters(ReadStrings(response));
+  m_genericFilter = filter;
+  m_genericFilterGeneration = currentGeneration;
+
+  // The filters changed since the caller got the generation, the generic
+  // selectors are kept for the caller's next attempt
+  if (currentGeneration != generation)
+    return std::shared_ptr<const CPluginFilter>();
+  return m_genericFilter;
+}
+
 std::vector<SubscriptionDescription> CAdblockPlusClient::FetchAvailableSubscriptions()
 {
   Communication::InputBuffer response;
@@ -365,6 +485,7 @@ void CAdblockPlusClient::SetSubscription(const std::wstring& url)
   Communication::OutputBuffer request;
   request << Communication::PROC_SET_SUBSCRIPTION << ToUtf8String(url);
   CallEngine(request);
+  m_blockCache.Invalidate();
 }
 
 void CAdblockPlusClient::AddSubscription(const std::wstring& url)
@@ -372,6 +493,7 @@ void CAdblockPlusClient::AddSubscription(const std::wstring& url)
   Communication::OutputBuffer request;
   request << Communication::PROC_ADD_SUBSCRIPTION << ToUtf8String(url);
   CallEngine(request);
+  m_blockCache.Invalidate();
 }
 
 void CAdblockPlusClient::RemoveSubscription(const std::wstring& url)
@@ -379,11 +501,14 @@ void CAdblockPlusClient::RemoveSubscription(const std::wstring& url)
   Communication::OutputBuffer request;
   request << Communication::PROC_REMOVE_SUBSCRIPTION << ToUtf8String(url);
   CallEngine(request);
+  m_blockCache.Invalidate();
 }
 
 
 void CAdblockPlusClient::UpdateAllSubscriptions()
 {
+  // The download finishes asynchronously, the cache is invalidated once the
+  // engine reports the new filter generation
   CallEngine(Communication::PROC_UPDATE_ALL_SUBSCRIPTIONS);
 }
 
@@ -410,6 +535,7 @@ void CAdblockPlusClient::AddFilter(const std::wstring& text)
   Communication::OutputBuffer request;
   request << Communication::PROC_ADD_FILTER << ToUtf8String(text);
   CallEngine(request);
+  m_blockCache.Invalidate();
 }
 
 void CAdblockPlusClient::RemoveFilter(const std::wstring& text)
@@ -417,6 +543,7 @@ void CAdblockPlusClient::RemoveFilter(const std::wstring& text)
   Communication::OutputBuffer request;
   request << Communication::PROC_REMOVE_FILTER << ToUtf8String(text);
   CallEngine(request);
+  m_blockCache.Invalidate();
 }
 
 void CAdblockPlusClient::SetPref(const std::wstring& name, const std::wstring& value)
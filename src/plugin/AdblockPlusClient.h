@@ -21,8 +21,11 @@
 
 #include "PluginTypedef.h"
 #include "PluginClientBase.h"
+#include "PluginFilter.h"
+#include "../shared/Channel.h"
 #include "../shared/Communication.h"
 #include "../shared/CriticalSection.h"
+#include "../shared/ShardedLruCache.h"
 
 
 class CPluginFilter;
@@ -35,19 +38,74 @@ struct SubscriptionDescription
   bool listed;
 };
 
+struct SourceDescription
+{
+  std::wstring src;
+  int contentType;
+};
+
+// Blocking decisions depend on the document domain and the content type as
+// well, not just on the source URL.
+struct BlockCacheKey
+{
+  std::wstring src;
+  int contentType;
+  std::wstring domain;
+  size_t hash;
+
+  BlockCacheKey(const std::wstring& src, int contentType, const std::wstring& domain)
+    : src(src), contentType(contentType), domain(domain)
+  {
+    std::hash<std::wstring> hasher;
+    hash = hasher(src);
+    hash = hash * 31 + static_cast<size_t>(contentType);
+    hash = hash * 31 + hasher(domain);
+  }
+
+  bool operator==(const BlockCacheKey& other) const
+  {
+    return hash == other.hash && contentType == other.contentType &&
+        src == other.src && domain == other.domain;
+  }
+};
+
+struct BlockCacheKeyHash
+{
+  size_t operator()(const BlockCacheKey& key) const
+  {
+    return key.hash;
+  }
+};
+
+struct MatchRequest
+{
+  std::wstring url;
+  std::wstring contentType;
+  std::wstring domain;
+};
+
 class CAdblockPlusClient : public CPluginClientBase
 {
 
 private:
 
+  // ShouldBlock() only reads the content type names and asks the engine, no
+  // lock is needed
   std::auto_ptr<CPluginFilter> m_filter;
 
-  CComAutoCriticalSection m_criticalSectionFilter;
-  CComAutoCriticalSection m_criticalSectionCache;
+  // Invalidated whenever the engine reports a new filter generation, so that
+  // changes made by the engine itself (e.g. subscription updates) are seen
+  ShardedLruCache<BlockCacheKey, bool, BlockCacheKeyHash> m_blockCache;
+  std::atomic<int32_t> m_filterGeneration;
 
-  std::map<std::wstring, bool> m_cacheBlockedSources;
+  // Generic element hiding selectors, shared by all tabs of this process
+  std::shared_ptr<const CPluginFilter> m_genericFilter;
+  int32_t m_genericFilterGeneration;
+  CriticalSection m_genericFilterLock;
 
-  std::shared_ptr<Communication::Pipe> enginePipe;
+  // Calls from different threads are multiplexed over one connection, the
+  // lock only protects (re)connecting.
+  std::shared_ptr<Communication::Channel> engineChannel;
   CriticalSection enginePipeLock;
 
 
@@ -56,6 +114,8 @@ private:
 
   bool CallEngine(Communication::OutputBuffer& message, Communication::InputBuffer& inputBuffer = Communication::InputBuffer());
   bool CallEngine(Communication::ProcType proc, Communication::InputBuffer& inputBuffer = Communication::InputBuffer());
+  // Called with the filter generation of every engine response that has one
+  void UpdateFilterGeneration(int32_t generation);
 public:
 
   static CAdblockPlusClient* s_instance;
@@ -67,13 +127,26 @@ public:
   // Removes the url from the list of whitelisted urls if present
   // Only called from ui thread
   bool ShouldBlock(const std::wstring& src, int contentType, const std::wstring& domain, bool addDebug=false);
+  // Resolves all sources not found in the cache with a single engine call
+  std::vector<bool> ShouldBlock(const std::vector<SourceDescription>& sources, const std::wstring& domain);
 
-  bool IsElementHidden(const std::wstring& tag, IHTMLElement* pEl, const std::wstring& domain, const std::wstring& indent, CPluginFilter* filter);
+  bool IsElementHidden(const ElementSnapshot& element, const AncestorFilter& ancestors, const CPluginFilter::DocumentRules* rules,
+    const std::wstring& domain, const std::wstring& indent, CPluginFilter* filter);
   bool IsWhitelistedUrl(const std::wstring& url);
   bool IsElemhideWhitelistedOnDomain(const std::wstring& url);
 
   bool Matches(const std::wstring& url, const std::wstring& contentType, const std::wstring& domain);
+  std::vector<bool> Matches(const std::vector<MatchRequest>& requests);
   std::vector<std::wstring> GetElementHidingSelectors(const std::wstring& domain);
+  // Gets the selectors a domain needs on top of the generic ones, along with
+  // the generic selectors that don't apply on it. The generation identifies
+  // the matching set of generic selectors, see GetGenericFilter().
+  bool GetElementHidingSelectorsDelta(const std::wstring& domain, int32_t& generation,
+      std::vector<std::wstring>& selectors, std::vector<std::wstring>& excludedSelectors);
+  // Returns the generic selectors of the given generation, they are only
+  // fetched and parsed once and then shared by all tabs. Returns null if the
+  // call fails or the engine has moved on to another generation.
+  std::shared_ptr<const CPluginFilter> GetGenericFilter(int32_t generation);
   std::vector<SubscriptionDescription> FetchAvailableSubscriptions();
   std::vector<SubscriptionDescription> GetListedSubscriptions();
   bool IsAcceptableAdsEnabled();
@@ -29,22 +29,99 @@ CPluginDomTraverser::CPluginDomTraverser(CPluginTab* tab) : CPluginDomTraverserB
 }
 
 
-bool CPluginDomTraverser::OnIFrame(IHTMLElement* pEl, const std::wstring& url, CString& indent)
+void CPluginDomTraverser::OnSubtree(IHTMLElement* pEl)
 {
-  CPluginClient* client = CPluginClient::GetInstance();
+  // With style sheets in place, only the selectors CSS can't express are left
+  // for OnElement
+  if (!m_tab->m_filter.get())
+  {
+    return;
+  }
+  bool isStyleSheetHiding = m_tab->m_elementHidingPrefs.isStyleSheetHiding && InjectStyleSheets(pEl);
+  m_tab->m_filter->SelectElementHideRules(m_documentRules, !isStyleSheetHiding);
+}
 
-  // If src should be blocked, set style display:none on iframe
-  bool isBlocked = client->ShouldBlock(url, CFilter::contentTypeSubdocument, m_domain);
-  if (isBlocked)
+
+void CPluginDomTraverser::ClearCache()
+{
+  CPluginDomTraverserBase::ClearCache();
+  m_styledDocuments.clear();
+}
+
+
+bool CPluginDomTraverser::InjectStyleSheets(IHTMLElement* pEl)
+{
+  CComPtr<IDispatch> pDocDispatch;
+  if (FAILED(pEl->get_document(&pDocDispatch)) || !pDocDispatch)
+  {
+    return false;
+  }
+  CComQIPtr<IHTMLDocument2> pDoc = pDocDispatch;
+  if (!pDoc)
   {
-    HideElement(pEl, "iframe", url, true, indent);
+    return false;
   }
 
-  return !isBlocked;
+  // Once per document, subtrees of the same document are traversed on their
+  // own in incremental mode
+  CComPtr<IUnknown> pIdentity;
+  pDoc->QueryInterface(IID_IUnknown, (LPVOID*)&pIdentity);
+  for (size_t i = 0; i < m_styledDocuments.size(); i++)
+  {
+    if (m_styledDocuments[i].m_T == pIdentity)
+    {
+      return true;
+    }
+  }
+
+  DWORD startTime = GetTickCount();
+  std::vector<std::wstring> styleSheets = m_tab->m_filter->GetHidingStyleSheets();
+  for (std::vector<std::wstring>::const_iterator it = styleSheets.begin(); it != styleSheets.end(); ++it)
+  {
+    // Fails once the document has 31 style sheets in IE 9 and below, the
+    // traversal then takes care of all selectors
+    CComPtr<IHTMLStyleSheet> pStyleSheet;
+    if (FAILED(pDoc->createStyleSheet(CComBSTR(L""), -1, &pStyleSheet)) || !pStyleSheet ||
+        FAILED(pStyleSheet->put_cssText(CComBSTR(static_cast<int>(it->size()), it->c_str()))))
+    {
+      DEBUG_HIDE_EL(L"HideEl::Failed to inject style sheet")
+      return false;
+    }
+  }
+
+  m_styledDocuments.push_back(pIdentity);
+  DEBUG_HIDE_EL(ToCString(L"HideEl::Injected " + std::to_wstring(static_cast<unsigned long long>(styleSheets.size())) +
+    L" style sheets in " + std::to_wstring(static_cast<unsigned long long>(GetTickCount() - startTime)) + L" ms"))
+  return true;
 }
 
 
-bool CPluginDomTraverser::OnElement(IHTMLElement* pEl, const CString& tag, CPluginDomTraverserCache* cache, bool isDebug, CString& indent)
+std::vector<bool> CPluginDomTraverser::OnIFrames(const std::vector<IHTMLElement*>& iframes, const std::vector<std::wstring>& urls, CString& indent)
+{
+  std::vector<SourceDescription> sources(iframes.size());
+  for (size_t i = 0; i < iframes.size(); i++)
+  {
+    sources[i].src = urls[i];
+    sources[i].contentType = CFilter::contentTypeSubdocument;
+  }
+
+  // If src should be blocked, set style display:none on iframe
+  std::vector<bool> isBlocked = CPluginClient::GetInstance()->ShouldBlock(sources, m_domain);
+  std::vector<bool> isTraversed(iframes.size());
+  for (size_t i = 0; i < iframes.size(); i++)
+  {
+    if (isBlocked[i])
+    {
+      HideElement(iframes[i], "iframe", urls[i], true, indent);
+    }
+    isTraversed[i] = !isBlocked[i];
+  }
+  return isTraversed;
+}
+
+
+bool CPluginDomTraverser::OnElement(IHTMLElement* pEl, const CString& tag, const ElementSnapshot& element,
+  const AncestorFilter& ancestors, CPluginDomTraverserCache* cache, bool isDebug, CString& indent)
 {
   if (cache->m_isHidden)
   {
@@ -54,7 +131,7 @@ bool CPluginDomTraverser::OnElement(IHTMLElement* pEl, const CString& tag, CPlug
   // Check if element is hidden
   CPluginClient* client = CPluginClient::GetInstance();
 
-  cache->m_isHidden = client->IsElementHidden(ToWstring(tag), pEl, m_domain, ToWstring(indent), m_tab->m_filter.get());
+  cache->m_isHidden = client->IsElementHidden(element, ancestors, &m_documentRules, m_domain, ToWstring(indent), m_tab->m_filter.get());
   if (cache->m_isHidden)
   {
     HideElement(pEl, tag, L"", false, indent);
@@ -71,13 +148,17 @@ bool CPluginDomTraverser::OnElement(IHTMLElement* pEl, const CString& tag, CPlug
       std::wstring src(vAttr.bstrVal, SysStringLen(vAttr.bstrVal));
       UnescapeUrl(src);
 
-      // If src should be blocked, set style display:none on image
-      cache->m_isHidden = client->ShouldBlock(src, CFilter::contentTypeImage, m_domain);
-      if (cache->m_isHidden)
-      {
-        HideElement(pEl, "image", src, true, indent);
-        return false;
-      }
+      // The source is checked together with the rest of the slice in OnSliceDone
+      PendingImage image;
+      image.element = pEl;
+      image.cache = cache;
+      image.indent = indent;
+      m_pendingImages.push_back(image);
+
+      SourceDescription source;
+      source.src = src;
+      source.contentType = CFilter::contentTypeImage;
+      m_pendingSources.push_back(source);
     }
   }
   // Objects
@@ -131,6 +212,43 @@ bool CPluginDomTraverser::IsEnabled()
 }
 
 
+void CPluginDomTraverser::OnSliceDone()
+{
+  if (m_pendingImages.empty())
+  {
+    return;
+  }
+
+  // If src should be blocked, set style display:none on image
+  std::vector<bool> isBlocked = CPluginClient::GetInstance()->ShouldBlock(m_pendingSources, m_domain);
+  for (size_t i = 0; i < m_pendingImages.size(); i++)
+  {
+    if (isBlocked[i])
+    {
+      HideElement(m_pendingImages[i].element, "image", m_pendingSources[i].src, true, m_pendingImages[i].indent);
+    }
+  }
+
+  m_criticalSection.Lock();
+  {
+    for (size_t i = 0; i < m_pendingImages.size(); i++)
+    {
+      m_pendingImages[i].cache->m_isHidden = isBlocked[i];
+    }
+  }
+  m_criticalSection.Unlock();
+
+  m_pendingImages.clear();
+  m_pendingSources.clear();
+}
+
+
+bool CPluginDomTraverser::IsIncremental()
+{
+  return m_tab->m_elementHidingPrefs.isIncremental;
+}
+
+
 void CPluginDomTraverser::HideElement(IHTMLElement* pEl, const CString& type, const std::wstring& url, bool isDebug, CString& indent)
 {
   CComPtr<IHTMLStyle> pStyle;
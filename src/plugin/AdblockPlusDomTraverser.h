@@ -20,6 +20,7 @@
 
 
 #include "PluginDomTraverserBase.h"
+#include "PluginFilter.h"
 
 
 class CPluginTab;
@@ -44,15 +45,42 @@ public:
 
   CPluginDomTraverser(CPluginTab* tab);
 
+  void ClearCache();
+
 protected:
 
-  bool OnIFrame(IHTMLElement* pEl, const std::wstring& url, CString& indent);
-  bool OnElement(IHTMLElement* pEl, const CString& tag, CPluginDomTraverserCache* cache, bool isDebug, CString& indent);
+  void OnSubtree(IHTMLElement* pEl);
+  std::vector<bool> OnIFrames(const std::vector<IHTMLElement*>& iframes, const std::vector<std::wstring>& urls, CString& indent);
+  bool OnElement(IHTMLElement* pEl, const CString& tag, const ElementSnapshot& element,
+    const AncestorFilter& ancestors, CPluginDomTraverserCache* cache, bool isDebug, CString& indent);
+  void OnSliceDone();
 
   bool IsEnabled();
+  bool IsIncremental();
 
   void HideElement(IHTMLElement* pEl, const CString& type, const std::wstring& url, bool isDebug, CString& indent);
 
+private:
+
+  // An image whose source is checked at the end of the slice
+  struct PendingImage
+  {
+    CComPtr<IHTMLElement> element;
+    CPluginDomTraverserCache* cache;
+    CString indent;
+  };
+
+  // Returns false if the style sheets couldn't be injected
+  bool InjectStyleSheets(IHTMLElement* pEl);
+
+  // Element hiding rules checked in the subtree being traversed
+  CPluginFilter::DocumentRules m_documentRules;
+  // Documents the style sheets were injected into
+  std::vector<CAdapt<CComPtr<IUnknown> > > m_styledDocuments;
+  // Images and their sources seen in the current slice
+  std::vector<PendingImage> m_pendingImages;
+  std::vector<SourceDescription> m_pendingSources;
+
 };
 
 
@@ -153,6 +153,9 @@
 
 #define ENGINE_STARTUP_TIMEOUT 10000
 
+// Maximum number of blocking decisions cached by the client
+#define BLOCK_CACHE_SIZE 16384
+
 
 
 #endif // _CONFIG_H
@@ -85,6 +85,12 @@ STDAPI DllCanUnloadNow(void)
       delete CPluginSettings::s_instance;
     }
 
+    // Stops the thread reading the engine's responses, it runs code of this DLL
+    if (CPluginClient::s_instance != NULL)
+    {
+      delete CPluginClient::s_instance;
+    }
+
     if (CPluginClass::s_mimeFilter != NULL)
     {
       CPluginClass::s_mimeFilter->Unregister();
@@ -0,0 +1,128 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PluginAncestorFilter.h"
+
+namespace
+{
+  // FNV-1a, salted so that e.g. a tag and an id with the same name differ
+  uint32_t Hash(wchar_t salt, const wchar_t* str, size_t length)
+  {
+    uint32_t hash = 2166136261U;
+    hash = (hash ^ static_cast<uint32_t>(salt)) * 16777619U;
+    for (size_t i = 0; i < length; i++)
+    {
+      hash = (hash ^ static_cast<uint32_t>(str[i])) * 16777619U;
+    }
+    return hash;
+  }
+
+  bool IsClassNameSeparator(wchar_t c)
+  {
+    return c == L' ' || c == L'\t' || c == L'\n' || c == L'\r';
+  }
+}
+
+// ============================================================================
+// AncestorFilter
+// ============================================================================
+
+AncestorFilter::AncestorFilter() : m_counters(1 << KEY_BITS, 0)
+{
+}
+
+uint32_t AncestorFilter::HashTag(const wchar_t* tag, size_t length)
+{
+  return Hash(L'<', tag, length);
+}
+
+uint32_t AncestorFilter::HashId(const wchar_t* id, size_t length)
+{
+  return Hash(L'#', id, length);
+}
+
+uint32_t AncestorFilter::HashClass(const wchar_t* className, size_t length)
+{
+  return Hash(L'.', className, length);
+}
+
+void AncestorFilter::Add(uint32_t hash)
+{
+  uint8_t& first = m_counters[hash & KEY_MASK];
+  uint8_t& second = m_counters[(hash >> KEY_BITS) & KEY_MASK];
+  // Saturated counters stay saturated, that only costs false positives
+  if (first != MAX_COUNT)
+    first++;
+  if (second != MAX_COUNT)
+    second++;
+  m_hashes.push_back(hash);
+}
+
+void AncestorFilter::Remove(uint32_t hash)
+{
+  uint8_t& first = m_counters[hash & KEY_MASK];
+  uint8_t& second = m_counters[(hash >> KEY_BITS) & KEY_MASK];
+  if (first != MAX_COUNT)
+    first--;
+  if (second != MAX_COUNT)
+    second--;
+}
+
+bool AncestorFilter::MayContain(uint32_t hash) const
+{
+  return m_counters[hash & KEY_MASK] && m_counters[(hash >> KEY_BITS) & KEY_MASK];
+}
+
+void AncestorFilter::PushElement(const std::wstring& tag, const std::wstring& id, const std::wstring& classNames)
+{
+  m_elements.push_back(m_hashes.size());
+  Add(HashTag(tag.c_str(), tag.size()));
+  if (!id.empty())
+  {
+    Add(HashId(id.c_str(), id.size()));
+  }
+  const wchar_t* classNamesEnd = classNames.c_str() + classNames.size();
+  for (const wchar_t* className = classNames.c_str(); className != classNamesEnd; )
+  {
+    if (IsClassNameSeparator(*className))
+    {
+      ++className;
+      continue;
+    }
+    const wchar_t* classNameEnd = className;
+    while (classNameEnd != classNamesEnd && !IsClassNameSeparator(*classNameEnd))
+    {
+      ++classNameEnd;
+    }
+    Add(HashClass(className, classNameEnd - className));
+    className = classNameEnd;
+  }
+}
+
+void AncestorFilter::PopElement()
+{
+  if (m_elements.empty())
+  {
+    return;
+  }
+  for (size_t i = m_elements.back(); i < m_hashes.size(); i++)
+  {
+    Remove(m_hashes[i]);
+  }
+  m_hashes.resize(m_elements.back());
+  m_elements.pop_back();
+}
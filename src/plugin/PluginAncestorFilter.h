@@ -0,0 +1,65 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PLUGIN_ANCESTOR_FILTER_H_
+#define _PLUGIN_ANCESTOR_FILTER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// ============================================================================
+// AncestorFilter
+// ============================================================================
+
+// Counting Bloom filter of the tag names, ids and class names of the
+// ancestors of the element currently being traversed. The traversal pushes an
+// element before descending into its children and pops it afterwards.
+// Selectors requiring an ancestor whose hashes aren't all present can't match
+// and are rejected without walking up the tree. False positives are possible,
+// false negatives are not.
+class AncestorFilter
+{
+public:
+  AncestorFilter();
+
+  // The tag has to be lower case
+  void PushElement(const std::wstring& tag, const std::wstring& id, const std::wstring& classNames);
+  void PopElement();
+
+  bool MayContain(uint32_t hash) const;
+
+  static uint32_t HashTag(const wchar_t* tag, size_t length);
+  static uint32_t HashId(const wchar_t* id, size_t length);
+  static uint32_t HashClass(const wchar_t* className, size_t length);
+
+private:
+  static const size_t KEY_BITS = 12;
+  static const uint32_t KEY_MASK = (1 << KEY_BITS) - 1;
+  static const uint8_t MAX_COUNT = 0xFF;
+
+  void Add(uint32_t hash);
+  void Remove(uint32_t hash);
+
+  // Two counters per hash, indexed by the lower and the upper key bits
+  std::vector<uint8_t> m_counters;
+  // Hashes of the pushed elements and where each element's hashes start
+  std::vector<uint32_t> m_hashes;
+  std::vector<size_t> m_elements;
+};
+
+#endif // _PLUGIN_ANCESTOR_FILTER_H_
@@ -0,0 +1,170 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PluginStdAfx.h"
+#include "PluginDomMutationListener.h"
+
+static const CComBSTR s_DOMNodeInserted = L"DOMNodeInserted";
+static const CComBSTR s_DOMAttrModified = L"DOMAttrModified";
+static const CComBSTR s_Events[] = {s_DOMNodeInserted, s_DOMAttrModified};
+
+
+CPluginDomMutationListener::CPluginDomMutationListener() : m_observer(0)
+{
+}
+
+
+void CPluginDomMutationListener::SetObserver(Observer* observer)
+{
+  m_observer = observer;
+}
+
+
+bool CPluginDomMutationListener::Observe(IUnknown* pDocument)
+{
+  CComQIPtr<IEventTarget> pTarget = pDocument;
+  if (!pTarget)
+  {
+    return false;
+  }
+
+  // The events bubble up to the document
+  for (size_t i = 0; i < countof(s_Events); i++)
+  {
+    if (FAILED(pTarget->addEventListener(s_Events[i], this, VARIANT_FALSE)))
+    {
+      for (size_t j = 0; j < i; j++)
+      {
+        pTarget->removeEventListener(s_Events[j], this, VARIANT_FALSE);
+      }
+      return false;
+    }
+  }
+  m_targets.push_back(pTarget);
+  return true;
+}
+
+
+bool CPluginDomMutationListener::IsObserving(IUnknown* pDocument)
+{
+  for (size_t i = 0; i < m_targets.size(); i++)
+  {
+    if (m_targets[i].m_T.IsEqualObject(pDocument))
+    {
+      return true;
+    }
+  }
+  return false;
+}
+
+
+void CPluginDomMutationListener::StopObserving()
+{
+  for (size_t i = 0; i < m_targets.size(); i++)
+  {
+    for (size_t j = 0; j < countof(s_Events); j++)
+    {
+      m_targets[i].m_T->removeEventListener(s_Events[j], this, VARIANT_FALSE);
+    }
+  }
+  m_targets.clear();
+}
+
+
+STDMETHODIMP CPluginDomMutationListener::QueryInterface(REFIID riid, void **ppvObj)
+{
+  if (IID_IUnknown == riid  ||  IID_IDispatch == riid)
+  {
+    *ppvObj = (LPVOID)this;
+    return NOERROR;
+  }
+
+  return E_NOINTERFACE;
+}
+
+
+/*
+CPluginDomMutationListener is not allocated on its own, its owner removes it
+from all documents before it goes away
+*/
+
+ULONG __stdcall CPluginDomMutationListener::AddRef()
+{
+  return 1;
+}
+
+
+ULONG __stdcall CPluginDomMutationListener::Release()
+{
+  return 1;
+}
+
+
+STDMETHODIMP CPluginDomMutationListener::GetTypeInfoCount(UINT* pctinfo)
+{
+  return E_NOTIMPL;
+}
+
+
+STDMETHODIMP CPluginDomMutationListener::GetTypeInfo(UINT itinfo, LCID lcid, ITypeInfo** pptinfo)
+{
+  return E_NOTIMPL;
+}
+
+
+STDMETHODIMP CPluginDomMutationListener::GetIDsOfNames(REFIID riid, LPOLESTR* rgszNames, UINT cNames, LCID lcid, DISPID* rgdispid)
+{
+  return E_NOTIMPL;
+}
+
+
+STDMETHODIMP CPluginDomMutationListener::Invoke(DISPID dispidMember, REFIID riid, LCID lcid, WORD wFlags, DISPPARAMS* pDispparams, VARIANT* pVarResult,
+                                                EXCEPINFO* pExcepinfo, UINT* pArgErr)
+{
+  // Listeners are called with the event as the only argument
+  if (!pDispparams)
+    return E_POINTER;
+
+  if (pDispparams->cArgs != 1 || pDispparams->rgvarg[0].vt != VT_DISPATCH || !pDispparams->rgvarg[0].pdispVal)
+    return DISP_E_BADPARAMCOUNT;
+
+  CComQIPtr<IDOMMutationEvent> pMutationEvent = pDispparams->rgvarg[0].pdispVal;
+  CComQIPtr<IDOMEvent> pEvent = pMutationEvent;
+  if (!pEvent || !m_observer)
+    return S_OK;
+
+  // Inline styles change all the time in animations, selectors hardly ever
+  // depend on them
+  CComBSTR bstrAttrName;
+  if (SUCCEEDED(pMutationEvent->get_attrName(&bstrAttrName)) && bstrAttrName &&
+      _wcsicmp(bstrAttrName, L"style") == 0)
+  {
+    return S_OK;
+  }
+
+  // Inserted text nodes aren't elements and don't matter
+  CComPtr<IEventTarget> pTarget;
+  if (SUCCEEDED(pEvent->get_target(&pTarget)) && pTarget)
+  {
+    CComQIPtr<IHTMLElement> pEl = pTarget;
+    if (pEl)
+    {
+      m_observer->OnSubtreeChanged(pEl);
+    }
+  }
+  return S_OK;
+}
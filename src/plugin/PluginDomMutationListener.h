@@ -0,0 +1,76 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PLUGIN_DOM_MUTATION_LISTENER_H_
+#define _PLUGIN_DOM_MUTATION_LISTENER_H_
+
+
+#include <vector>
+
+
+/*
+Listens to the DOM mutation events of the documents it observes and reports
+the inserted elements and the elements whose attributes changed, so that only
+these subtrees need to be traversed again. Mutation events are only supported
+by documents in IE9 standards mode and later.
+Like CPluginUserSettings it is a member of its owner and not reference
+counted, the owner has to stop observing before it goes away.
+*/
+class CPluginDomMutationListener : public IDispatch
+{
+public:
+
+  class Observer
+  {
+  public:
+    virtual ~Observer() {}
+    // Called for the inserted element or the element whose attribute changed
+    virtual void OnSubtreeChanged(IHTMLElement* pEl) = 0;
+  };
+
+  CPluginDomMutationListener();
+
+  void SetObserver(Observer* observer);
+
+  // Returns false if the document doesn't support mutation events
+  bool Observe(IUnknown* pDocument);
+  bool IsObserving(IUnknown* pDocument);
+  void StopObserving();
+
+  // IUnknown
+  STDMETHOD(QueryInterface)(REFIID riid, void **ppvObj);
+  ULONG __stdcall AddRef();
+  ULONG __stdcall Release();
+
+  // IDispatch
+  STDMETHOD(GetTypeInfoCount)(UINT* pctinfo);
+  STDMETHOD(GetTypeInfo)(UINT itinfo, LCID lcid, ITypeInfo** pptinfo);
+  STDMETHOD(GetIDsOfNames)(REFIID riid, LPOLESTR* rgszNames, UINT cNames, LCID lcid, DISPID* rgdispid);
+  STDMETHOD(Invoke)(DISPID dispidMember, REFIID riid, LCID lcid, WORD wFlags, DISPPARAMS* pDispparams, VARIANT* pVarResult,
+    EXCEPINFO* pExcepinfo, UINT* pArgErr);
+
+private:
+
+  Observer* m_observer;
+  std::vector<CAdapt<CComPtr<IEventTarget> > > m_targets;
+
+  CPluginDomMutationListener(const CPluginDomMutationListener&);
+  CPluginDomMutationListener& operator=(const CPluginDomMutationListener&);
+};
+
+
+#endif // _PLUGIN_DOM_MUTATION_LISTENER_H_
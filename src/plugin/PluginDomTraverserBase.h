@@ -19,8 +19,16 @@
 #define _PLUGIN_DOM_TRAVERSER_BASE_H_
 
 
+#include <deque>
 #include "PluginTypedef.h"
 #include "PluginTab.h"
+#include "PluginAncestorFilter.h"
+#include "PluginDomMutationListener.h"
+#include "PluginElementIdentityTable.h"
+#include "PluginElementSnapshot.h"
+#include "PluginMshtmlElementView.h"
+#include "PluginSlabArena.h"
+#include "PluginTreeWalker.h"
 
 
 class CPluginDomTraverserCacheBase
@@ -34,7 +42,7 @@ public:
 };
 
 template <class T>
-class CPluginDomTraverserBase
+class CPluginDomTraverserBase : public CPluginDomMutationListener::Observer
 {
 
 public:
@@ -44,6 +52,8 @@ public:
 
   void TraverseHeader(bool isHeaderTraversed);
 
+  // Both start a new traversal, abandoning the one still in progress. The
+  // traversal runs in slices, see ContinueTraversal().
   void TraverseDocument(IWebBrowser2* pBrowser, const std::wstring& domain, const std::wstring& documentName);
   void TraverseSubdocument(IWebBrowser2* pBrowser, const std::wstring& domain, const CString& documentName);
 
@@ -51,15 +61,72 @@ public:
 
 protected:
 
-  virtual bool OnIFrame(IHTMLElement* pEl, const std::wstring& url, CString& indent) { return true; }
-  virtual bool OnElement(IHTMLElement* pEl, const CString& tag, T* cache, bool isDebug, CString& indent) { return true; }
+  // Called once per document with the root of the subtree about to be traversed
+  virtual void OnSubtree(IHTMLElement* pEl) {}
+  // Called once per document with all its iframes, returns for each one
+  // whether it should be traversed
+  virtual std::vector<bool> OnIFrames(const std::vector<IHTMLElement*>& iframes, const std::vector<std::wstring>& urls,
+    CString& indent) { return std::vector<bool>(iframes.size(), true); }
+  // The ancestor filter holds the ancestors of the element, see AncestorFilter
+  virtual bool OnElement(IHTMLElement* pEl, const CString& tag, const ElementSnapshot& element,
+    const AncestorFilter& ancestors, T* cache, bool isDebug, CString& indent) { return true; }
+  // Called after every slice and before the traversal is abandoned, the
+  // cache entries passed to OnElement() stay valid until then
+  virtual void OnSliceDone() {}
 
   virtual bool IsEnabled();
+  // In incremental mode documents are only traversed once, afterwards only
+  // the subtrees reported by the mutation listener are
+  virtual bool IsIncremental() { return false; }
+
+  void OnSubtreeChanged(IHTMLElement* pEl);
 
 protected:
 
-  void TraverseDocument(IWebBrowser2* pBrowser, bool isMainDoc, CString indent);
-  void TraverseChild(IHTMLElement* pEl, IWebBrowser2* pBrowser, CString& indent, bool isCached=true);
+  // A slice visits at most this many elements or runs at most this long
+  // before yielding back to the message loop
+  static const int SLICE_MAX_ELEMENTS = 500;
+  static const long long SLICE_MAX_MICROSECONDS = 10000;
+
+  // Walked by TreeWalker
+  typedef CComPtr<IHTMLElement> Node;
+  typedef CComPtr<IHTMLElementCollection> Children;
+  struct State
+  {
+    int cacheIndex;
+    bool isCached;
+  };
+  friend class TreeWalker<CPluginDomTraverserBase<T> >;
+
+  // A frame or iframe document waiting for its turn
+  struct PendingDocument
+  {
+    CComPtr<IWebBrowser2> browser;
+    bool isMainDoc;
+    CString indent;
+  };
+
+  void StartTraversal(IWebBrowser2* pBrowser, bool isMainDoc);
+  void ResetStatistics();
+  void AbortTraversal();
+  // Runs one slice of the traversal and schedules the next one if needed
+  void ContinueTraversal();
+  void StartDocument(const PendingDocument& document);
+  void StartSubtree(IHTMLElement* pEl);
+  void SeedAncestors(IHTMLElement* pEl);
+  void FinishDocument();
+  bool Enter(const Node& pEl, const State& parent, size_t depth, Children& children, size_t& childCount, State& state);
+  void Leave(const Node& pEl, const State& state);
+  bool GetChild(const Children& children, size_t index, Node& child);
+  CString GetIndent(size_t depth) const;
+  static CComPtr<IUnknown> GetIdentity(IHTMLElement* pEl);
+  bool GetIFrameSource(IHTMLElement* pFrameEl, std::wstring& src);
+
+  bool ScheduleSlice();
+  void CancelSlice();
+  bool AreFiltersLoaded();
+  static void CALLBACK OnSliceTimer(HWND hWnd, UINT message, UINT_PTR idEvent, DWORD time);
+  static long long GetMicroseconds();
 
   CComAutoCriticalSection m_criticalSection;
 
@@ -71,29 +138,67 @@ protected:
   // Caching	
   long m_cacheDomElementCount;
 
-  int m_cacheIndexLast;
-  int m_cacheElementsMax;
   std::set<CString> m_cacheDocumentHasFrames;
   std::set<CString> m_cacheDocumentHasIframes;
 
-  T* m_cacheElements;
+  SlabArena<T> m_cacheElements;
+  // Cache index of the visited elements, no attributes are written to the
+  // DOM. Holds on to the elements so their addresses aren't reused.
+  ElementIdentityTable m_cacheIndices;
+  SlabArena<CAdapt<CComPtr<IUnknown> > > m_cacheIdentities;
 
   CPluginTab* m_tab;
   CComPtr<IWebBrowser2> m_pBrowser;
+
+  // Traversal cursor, the document being traversed and the open elements
+  CComQIPtr<IHTMLDocument3> m_document;
+  CString m_documentIndent;
+  CComPtr<IHTMLElement> m_walkRoot;
+  TreeWalker<CPluginDomTraverserBase<T> > m_walker;
+  std::deque<PendingDocument> m_pendingDocuments;
+  AncestorFilter m_ancestors;
+
+  // Incremental mode, whether the changes of the document being traversed are
+  // reported and the subtrees that changed since they were traversed
+  bool m_isIncremental;
+  bool m_isObserved;
+  bool m_isInSlice;
+  CPluginDomMutationListener m_mutationListener;
+  std::deque<CAdapt<CComPtr<IHTMLElement> > > m_changedSubtrees;
+
+  // Statistics of the traversal in progress
+  long long m_traversalStart;
+  long long m_traversalBusy;
+  int m_traversalSlices;
+  long m_traversalElements;
+
+  // Timers set with SetTimer() and no window only identify themselves by id
+  UINT_PTR m_sliceTimer;
+  static std::map<UINT_PTR, CPluginDomTraverserBase<T>*> s_sliceTimers;
+  static CComAutoCriticalSection s_criticalSectionSliceTimers;
 };
 
+template <class T>
+std::map<UINT_PTR, CPluginDomTraverserBase<T>*> CPluginDomTraverserBase<T>::s_sliceTimers;
+
+template <class T>
+CComAutoCriticalSection CPluginDomTraverserBase<T>::s_criticalSectionSliceTimers;
+
 template <class T>
 CPluginDomTraverserBase<T>::CPluginDomTraverserBase(CPluginTab* tab) : 
-  m_tab(tab), m_isHeaderTraversed(false), m_cacheDomElementCount(0), m_cacheIndexLast(0), m_cacheElementsMax(5000)
+  m_tab(tab), m_isHeaderTraversed(false), m_cacheDomElementCount(0),
+  m_isIncremental(false), m_isObserved(false), m_isInSlice(false),
+  m_traversalStart(0), m_traversalBusy(0), m_traversalSlices(0), m_traversalElements(0), m_sliceTimer(0)
 {
-  m_cacheElements = new T[m_cacheElementsMax];
+  m_mutationListener.SetObserver(this);
 }
 
 
 template <class T>
 CPluginDomTraverserBase<T>::~CPluginDomTraverserBase()
 {
-  delete [] m_cacheElements;
+  AbortTraversal();
+  m_mutationListener.StopObserving();
 }
 
 template <class T>
@@ -107,7 +212,7 @@ void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, const
 {
   m_domain = domain;
 
-  TraverseDocument(pBrowser, true, "");
+  StartTraversal(pBrowser, true);
 }
 
 
@@ -116,7 +221,7 @@ void CPluginDomTraverserBase<T>::TraverseSubdocument(IWebBrowser2* pBrowser, con
 {
   m_domain = domain;
 
-  TraverseDocument(pBrowser, false, "");
+  StartTraversal(pBrowser, false);
 }
 
 
@@ -128,11 +233,174 @@ bool CPluginDomTraverserBase<T>::IsEnabled()
 
 
 template <class T>
-void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, bool isMainDoc, CString indent)
+void CPluginDomTraverserBase<T>::StartTraversal(IWebBrowser2* pBrowser, bool isMainDoc)
+{
+  AbortTraversal();
+
+  PendingDocument document;
+  document.browser = pBrowser;
+  document.isMainDoc = isMainDoc;
+  m_pendingDocuments.push_back(document);
+
+  ResetStatistics();
+  ContinueTraversal();
+}
+
+
+template <class T>
+void CPluginDomTraverserBase<T>::ResetStatistics()
+{
+  m_traversalStart = GetMicroseconds();
+  m_traversalBusy = 0;
+  m_traversalSlices = 0;
+  m_traversalElements = 0;
+}
+
+
+template <class T>
+void CPluginDomTraverserBase<T>::OnSubtreeChanged(IHTMLElement* pEl)
 {
-  DWORD res = WaitForSingleObject(m_tab->m_filter->hideFiltersLoadedEvent, ENGINE_STARTUP_TIMEOUT);
+  // Hiding elements and injecting style sheets changes the DOM as well
+  if (m_isInSlice)
+  {
+    return;
+  }
+
+  if (!m_changedSubtrees.empty() && m_changedSubtrees.back().m_T.IsEqualObject(pEl))
+  {
+    return;
+  }
+  m_changedSubtrees.push_back(CComPtr<IHTMLElement>(pEl));
+
+  // Otherwise the traversal in progress gets to the subtree by itself
+  if (!m_sliceTimer)
+  {
+    ResetStatistics();
+    if (!ScheduleSlice())
+    {
+      ContinueTraversal();
+    }
+  }
+}
+
+
+template <class T>
+void CPluginDomTraverserBase<T>::AbortTraversal()
+{
+  CancelSlice();
+  OnSliceDone();
+
+  // The element counts of the open elements are already cached, make sure
+  // their subtrees aren't skipped next time
+  m_criticalSection.Lock();
+  {
+    for (size_t i = 0; i < m_walker.GetDepth(); i++)
+    {
+      m_cacheElements[m_walker.GetState(i).cacheIndex].m_elements = -1;
+    }
+  }
+  m_criticalSection.Unlock();
+
+  // The rest of a document whose changes are reported wouldn't be traversed
+  // again otherwise
+  if (m_isObserved && !m_walker.IsDone() && m_walkRoot)
+  {
+    m_changedSubtrees.push_front(m_walkRoot);
+  }
+
+  m_walker.Clear();
+  m_walkRoot.Release();
+  m_pendingDocuments.clear();
+  m_document.Release();
+  m_ancestors = AncestorFilter();
+}
+
+
+template <class T>
+void CPluginDomTraverserBase<T>::ContinueTraversal()
+{
+  long long sliceStart = GetMicroseconds();
+  long sliceElements = m_traversalElements;
+  long long budgetStart = sliceStart;
+  long budgetElements = sliceElements;
+  m_traversalSlices++;
+  m_isInSlice = true;
+
+  while (true)
+  {
+    if (m_walker.IsDone())
+    {
+      if (m_document)
+      {
+        FinishDocument();
+      }
+      if (!m_pendingDocuments.empty())
+      {
+        // Never block the UI thread while the filters are loading, the
+        // following slices poll for them instead
+        if (!AreFiltersLoaded() && ScheduleSlice())
+        {
+          break;
+        }
+        PendingDocument document = m_pendingDocuments.front();
+        m_pendingDocuments.pop_front();
+        StartDocument(document);
+        continue;
+      }
+      if (!m_changedSubtrees.empty())
+      {
+        CComPtr<IHTMLElement> pEl = m_changedSubtrees.front().m_T;
+        m_changedSubtrees.pop_front();
+        StartSubtree(pEl);
+        continue;
+      }
+      break;
+    }
+
+    if (m_traversalElements - budgetElements >= SLICE_MAX_ELEMENTS ||
+        GetMicroseconds() - budgetStart >= SLICE_MAX_MICROSECONDS)
+    {
+      if (ScheduleSlice())
+      {
+        break;
+      }
+      // Without a timer there is no way to yield, finish synchronously
+      OnSliceDone();
+      budgetStart = GetMicroseconds();
+      budgetElements = m_traversalElements;
+    }
+
+    m_walker.Step(*this);
+  }
+  OnSliceDone();
+  m_isInSlice = false;
+
+  long long sliceEnd = GetMicroseconds();
+  m_traversalBusy += sliceEnd - sliceStart;
+  DEBUG_HIDE_EL(ToCString(L"HideEl::Slice " + std::to_wstring(static_cast<long long>(m_traversalSlices)) + L": " +
+    std::to_wstring(static_cast<long long>(m_traversalElements - sliceElements)) + L" elements in " +
+    std::to_wstring(sliceEnd - sliceStart) + L" us"))
+  if (!m_sliceTimer)
+  {
+    DEBUG_HIDE_EL(ToCString(L"HideEl::Traversed " + std::to_wstring(static_cast<long long>(m_traversalElements)) +
+      L" elements in " + std::to_wstring(static_cast<long long>(m_traversalSlices)) + L" slices, " +
+      std::to_wstring((sliceEnd - m_traversalStart) / 1000) + L" ms total, " +
+      std::to_wstring(m_traversalBusy / 1000) + L" ms busy"))
+  }
+}
+
+
+template <class T>
+void CPluginDomTraverserBase<T>::StartDocument(const PendingDocument& document)
+{
+  // Only waits if no slice could be scheduled, see ContinueTraversal()
+  WaitForSingleObject(m_tab->m_filter->hideFiltersLoadedEvent, ENGINE_STARTUP_TIMEOUT);
   if (!IsEnabled()) return;
 
+  // Read along with the filters, see CPluginTabBase::m_elementHidingPrefs
+  m_isIncremental = IsIncremental();
+
+  IWebBrowser2* pBrowser = document.browser;
   VARIANT_BOOL isBusy;
   if (SUCCEEDED(pBrowser->get_Busy(&isBusy)))
   {
@@ -190,18 +458,81 @@ void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, bool i
   }
 
   // Clear cache (if eg. refreshing) ???
-  if (isMainDoc)
+  if (document.isMainDoc)
   {
-    CComVariant vCacheIndex;
+    int cacheIndex = -1;
+    m_criticalSection.Lock();
+    {
+      cacheIndex = m_cacheIndices.Find(GetIdentity(pBodyEl));
+    }
+    m_criticalSection.Unlock();
 
-    if (FAILED(pBodyEl->getAttribute(L"abp", 0, &vCacheIndex)) || vCacheIndex.vt == VT_NULL)
+    if (cacheIndex < 0)
     {
       ClearCache();
     }
   }
 
-  // Hide elements in body part
-  TraverseChild(pBodyEl, pBrowser, indent);
+  // In incremental mode a document is traversed once, afterwards only the
+  // subtrees the mutation listener reports are
+  bool isTraversed = false;
+  m_isObserved = false;
+  if (m_isIncremental)
+  {
+    isTraversed = m_mutationListener.IsObserving(pDoc);
+    m_isObserved = isTraversed || m_mutationListener.Observe(pDoc);
+  }
+
+  // Hide elements in body part, the frames are checked once it is done
+  m_document = pDoc;
+  m_documentIndent = document.indent;
+  if (!isTraversed)
+  {
+    OnSubtree(pBodyEl);
+    SeedAncestors(pBodyEl);
+
+    State parent = {-1, true};
+    m_walkRoot = pBodyEl;
+    m_walker.Start(*this, pBodyEl, parent);
+  }
+}
+
+
+template <class T>
+void CPluginDomTraverserBase<T>::StartSubtree(IHTMLElement* pEl)
+{
+  if (!IsEnabled()) return;
+
+  m_isObserved = true;
+  OnSubtree(pEl);
+  SeedAncestors(pEl);
+
+  // Changed elements have to be checked again whatever the cache says
+  State parent = {-1, false};
+  m_walkRoot = pEl;
+  m_walker.Start(*this, pEl, parent);
+}
+
+
+template <class T>
+void CPluginDomTraverserBase<T>::SeedAncestors(IHTMLElement* pEl)
+{
+  // The traversal starts below the document element, selectors may still
+  // refer to the elements above
+  m_ancestors = AncestorFilter();
+  for (std::unique_ptr<ElementView> parent = MshtmlElementView(pEl).GetParent(); parent; parent = parent->GetParent())
+  {
+    m_ancestors.PushElement(parent->GetTagName(), parent->GetId(), parent->GetClassName());
+  }
+}
+
+
+template <class T>
+void CPluginDomTraverserBase<T>::FinishDocument()
+{
+  CComQIPtr<IHTMLDocument3> pDoc = m_document;
+  CString indent = m_documentIndent;
+  m_document.Release();
 
   // Check frames and iframes
   bool hasFrames = false;
@@ -214,6 +545,10 @@ void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, bool i
   }
   m_criticalSection.Unlock();
 
+  PendingDocument frameDocument;
+  frameDocument.isMainDoc = false;
+  frameDocument.indent = indent;
+
   // Frames
   if (hasFrames)
   {
@@ -246,16 +581,21 @@ void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, bool i
           }
           if (!src.empty())
           {
-            TraverseDocument(pFrameBrowser, false, indent);
+            frameDocument.browser = pFrameBrowser;
+            m_pendingDocuments.push_back(frameDocument);
           }
         }
       }
     }
   }
 
-  // Iframes
+  // Iframes, checked all at once
   if (hasIframes)
   {
+    std::vector<CAdapt<CComPtr<IHTMLElement> > > iframeElements;
+    std::vector<IHTMLElement*> iframes;
+    std::vector<std::wstring> urls;
+
     long frameCount = 0;
     CComPtr<IHTMLElementCollection> pFrameCollection;
     if (SUCCEEDED(pDoc->getElementsByTagName(L"iframe", &pFrameCollection)) && pFrameCollection)
@@ -273,40 +613,29 @@ void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, bool i
       if (SUCCEEDED(pFrameCollection->item(vIndex, vRetIndex, &pFrameDispatch)) && pFrameDispatch)
       {
         CComQIPtr<IHTMLElement> pFrameEl = pFrameDispatch;
-        if (pFrameEl)
+        std::wstring src;
+        if (pFrameEl && GetIFrameSource(pFrameEl, src))
         {
-          CComVariant vAttr;
+          iframeElements.push_back(pFrameEl);
+          urls.push_back(src);
+        }
+      }
+    }
 
-          if (SUCCEEDED(pFrameEl->getAttribute(L"src", 0, &vAttr)) && vAttr.vt == VT_BSTR && ::SysStringLen(vAttr.bstrVal) > 0)
-          {
-            CString srcLegacy = vAttr.bstrVal;
-
-            // Some times, domain is missing. Should this be added on image src's as well?''
-
-            // eg. gadgetzone.com.au
-            if (srcLegacy.Left(2) == L"//")
-            {
-              srcLegacy = L"http:" + srcLegacy;
-            }
-            // eg. http://w3schools.com/html/html_examples.asp
-            else if (srcLegacy.Left(4) != L"http" && srcLegacy.Left(6) != L"res://")
-            {
-              srcLegacy = L"http://" + ToCString(m_domain) + srcLegacy;
-            }
-            std::wstring src(ToWstring(srcLegacy));
-            UnescapeUrl(src);
+    for (size_t i = 0; i < iframeElements.size(); i++)
+    {
+      iframes.push_back(iframeElements[i].m_T);
+    }
 
-            // Check if Iframe should be traversed
-            if (OnIFrame(pFrameEl, src, indent))
-            {
-              CComQIPtr<IWebBrowser2> pFrameBrowser = pFrameDispatch;
-              if (pFrameBrowser)
-              {
-                TraverseDocument(pFrameBrowser, false, indent);
-              }
-            }
-          }
-        }
+    // Check if Iframe should be traversed
+    std::vector<bool> isTraversed = OnIFrames(iframes, urls, indent);
+    for (size_t i = 0; i < iframes.size(); i++)
+    {
+      CComQIPtr<IWebBrowser2> pFrameBrowser = iframes[i];
+      if (isTraversed[i] && pFrameBrowser)
+      {
+        frameDocument.browser = pFrameBrowser;
+        m_pendingDocuments.push_back(frameDocument);
       }
     }
   }
@@ -314,56 +643,82 @@ void CPluginDomTraverserBase<T>::TraverseDocument(IWebBrowser2* pBrowser, bool i
 
 
 template <class T>
-void CPluginDomTraverserBase<T>::TraverseChild(IHTMLElement* pEl, IWebBrowser2* pBrowser, CString& indent, bool isCached)
+bool CPluginDomTraverserBase<T>::GetIFrameSource(IHTMLElement* pFrameEl, std::wstring& src)
 {
+  CComVariant vAttr;
+  if (FAILED(pFrameEl->getAttribute(L"src", 0, &vAttr)) || vAttr.vt != VT_BSTR || ::SysStringLen(vAttr.bstrVal) == 0)
+  {
+    return false;
+  }
+
+  CString srcLegacy = vAttr.bstrVal;
+
+  // Some times, domain is missing. Should this be added on image src's as well?''
+
+  // eg. gadgetzone.com.au
+  if (srcLegacy.Left(2) == L"//")
+  {
+    srcLegacy = L"http:" + srcLegacy;
+  }
+  // eg. http://w3schools.com/html/html_examples.asp
+  else if (srcLegacy.Left(4) != L"http" && srcLegacy.Left(6) != L"res://")
+  {
+    srcLegacy = L"http://" + ToCString(m_domain) + srcLegacy;
+  }
+  src = ToWstring(srcLegacy);
+  UnescapeUrl(src);
+  return true;
+}
+
+
+template <class T>
+bool CPluginDomTraverserBase<T>::Enter(const Node& pEl, const State& parent, size_t depth, Children& children, size_t& childCount, State& state)
+{
+  m_traversalElements++;
+
+  bool isCached = parent.isCached;
   int  cacheIndex = -1;
   long cacheAllElementsCount = -1;
 
+  CComPtr<IUnknown> pIdentity = GetIdentity(pEl);
+  if (!pIdentity)
+  {
+    return false;
+  }
+
   m_criticalSection.Lock();
   {
-    CComVariant vCacheIndex;
-    if (isCached && SUCCEEDED(pEl->getAttribute(L"abp", 0, &vCacheIndex)) && vCacheIndex.vt == VT_I4)
+    // Elements checked again keep their entry, so that changing the same
+    // subtree over and over doesn't grow the cache
+    cacheIndex = m_cacheIndices.Find(pIdentity);
+    if (cacheIndex >= 0 && isCached)
     {
-      cacheIndex = vCacheIndex.intVal;
-
       cacheAllElementsCount = m_cacheElements[cacheIndex].m_elements;
     }
+    else if (cacheIndex >= 0)
+    {
+      m_cacheElements[cacheIndex].Init();
+    }
     else
     {
       isCached = false;
 
-      cacheIndex = m_cacheIndexLast++;
-
-      // Resize cache???
-      if (cacheIndex >= m_cacheElementsMax)
-      {
-        T* oldCacheElements = m_cacheElements;
-
-        m_cacheElements = new T[2*m_cacheElementsMax];
-
-        memcpy(m_cacheElements, oldCacheElements, m_cacheElementsMax*sizeof(T));
-
-        m_cacheElementsMax *= 2;
-
-        delete [] oldCacheElements;
-      }
-
+      cacheIndex = static_cast<int>(m_cacheElements.Add());
       m_cacheElements[cacheIndex].Init();
 
-      vCacheIndex.vt = VT_I4;
-      vCacheIndex.intVal = cacheIndex;
-
-      pEl->setAttribute(L"abp", vCacheIndex);
+      m_cacheIndices.Insert(pIdentity, cacheIndex);
+      m_cacheIdentities[m_cacheIdentities.Add()].m_T = pIdentity;
     }
   }
   m_criticalSection.Unlock();
 
-  // Get number of elements in the scope of pEl
-  long allElementsCount = 0;
+  // Get number of elements in the scope of pEl, not needed if the changes
+  // are reported by the mutation listener
+  long allElementsCount = m_isObserved ? -1 : 0;
 
   CComPtr<IDispatch> pAllCollectionDisp;
 
-  if (SUCCEEDED(pEl->get_all(&pAllCollectionDisp)) && pAllCollectionDisp)
+  if (!m_isObserved && SUCCEEDED(pEl->get_all(&pAllCollectionDisp)) && pAllCollectionDisp)
   {
     CComPtr<IHTMLElementCollection> pAllCollection;
 
@@ -372,7 +727,7 @@ void CPluginDomTraverserBase<T>::TraverseChild(IHTMLElement* pEl, IWebBrowser2*
       // If number of elements = cached number, return
       if (SUCCEEDED(pAllCollection->get_length(&allElementsCount)) && allElementsCount == cacheAllElementsCount)
       {
-        return;
+        return false;
       }
     }
   }
@@ -388,16 +743,19 @@ void CPluginDomTraverserBase<T>::TraverseChild(IHTMLElement* pEl, IWebBrowser2*
   CComBSTR bstrTag;
   if (FAILED(pEl->get_tagName(&bstrTag)) || !bstrTag)
   {
-    return;
+    return false;
   }
 
   CString tag = bstrTag;
   tag.MakeLower();
 
   // Custom OnElement
-  if (!OnElement(pEl, tag, &m_cacheElements[cacheIndex], false, indent))
+  MshtmlElementView view(pEl);
+  ElementSnapshot element(view, ToWstring(tag));
+  CString indent = GetIndent(depth);
+  if (!OnElement(pEl, tag, element, m_ancestors, &m_cacheElements[cacheIndex], false, indent))
   {
-    return;
+    return false;
   }
 
   // Update frame/iframe cache
@@ -418,54 +776,183 @@ void CPluginDomTraverserBase<T>::TraverseChild(IHTMLElement* pEl, IWebBrowser2*
     m_criticalSection.Unlock();
   }
 
-  // Iterate through children of this element
-  if (allElementsCount > 0)
+  // Children are visited by the following steps of the walker
+  state.cacheIndex = cacheIndex;
+  state.isCached = isCached;
+  if (allElementsCount != 0)
   {
-    long childElementsCount = 0;
-
     CComPtr<IDispatch> pChildCollectionDisp;
-    if (SUCCEEDED(pEl->get_children(&pChildCollectionDisp)) && pChildCollectionDisp)
+    if (SUCCEEDED(pEl->get_children(&pChildCollectionDisp)) && pChildCollectionDisp &&
+        SUCCEEDED(pChildCollectionDisp.QueryInterface(&children)) && children)
     {
-      CComPtr<IHTMLElementCollection> pChildCollection;
-      if (SUCCEEDED(pChildCollectionDisp->QueryInterface(IID_IHTMLElementCollection, (LPVOID*)&pChildCollection)) && pChildCollection)
+      long count = 0;
+      children->get_length(&count);
+      childCount = count;
+
+      // Usually already fetched by OnElement()
+      if (childCount > 0)
       {
-        pChildCollection->get_length(&childElementsCount);
+        m_ancestors.PushElement(element.GetTagName(), element.GetId(), element.GetClassName());
+      }
+    }
+  }
+  return true;
+}
 
-        CComVariant vIndex(0);
 
-        // Iterate through all children
-        for (long i = 0; i < childElementsCount; i++)
-        {
-          CComPtr<IDispatch> pChildElDispatch;
-          CComVariant vRetIndex;
+template <class T>
+void CPluginDomTraverserBase<T>::Leave(const Node& pEl, const State& state)
+{
+  m_ancestors.PopElement();
+}
 
-          vIndex.intVal = i;
 
-          if (SUCCEEDED(pChildCollection->item(vIndex, vRetIndex, &pChildElDispatch)) && pChildElDispatch)
-          {
-            CComPtr<IHTMLElement> pChildEl;
-            if (SUCCEEDED(pChildElDispatch->QueryInterface(IID_IHTMLElement, (LPVOID*)&pChildEl)) && pChildEl)
-            {
-              TraverseChild(pChildEl, pBrowser, indent + "  ", isCached);
-            }
-          }
-        }
-      }
-    }
+template <class T>
+bool CPluginDomTraverserBase<T>::GetChild(const Children& children, size_t index, Node& child)
+{
+  // The collection is live, children removed since the last slice fail to
+  // be fetched and are skipped
+  CComVariant vIndex(static_cast<long>(index));
+  CComVariant vRetIndex;
+  CComPtr<IDispatch> pChildElDispatch;
+  if (FAILED(children->item(vIndex, vRetIndex, &pChildElDispatch)) || !pChildElDispatch)
+  {
+    return false;
   }
+  return SUCCEEDED(pChildElDispatch.QueryInterface(&child)) && child;
+}
+
+
+template <class T>
+CString CPluginDomTraverserBase<T>::GetIndent(size_t depth) const
+{
+  // Only needed for the debug output, saves an allocation per element
+#if (defined ENABLE_DEBUG_INFO && defined ENABLE_DEBUG_HIDE_EL)
+  return m_documentIndent + CString(L' ', static_cast<int>(depth) * 2);
+#else
+  return CString();
+#endif
 }
 
 
 template <class T>
 void CPluginDomTraverserBase<T>::ClearCache()
 {
+  // A traversal still in progress refers to the cache entries
+  AbortTraversal();
+  m_mutationListener.StopObserving();
+  m_changedSubtrees.clear();
+
+  size_t residentSize = 0;
   m_criticalSection.Lock();
   {
-    m_cacheIndexLast = 0;
+    m_cacheElements.Clear();
+    m_cacheIndices.Clear();
+    m_cacheIdentities.Clear();
     m_cacheDocumentHasFrames.clear();
     m_cacheDocumentHasIframes.clear();
+    residentSize = m_cacheElements.GetResidentSize() + m_cacheIdentities.GetResidentSize();
   }
   m_criticalSection.Unlock();
+
+  DEBUG_HIDE_EL(ToCString(L"HideEl::Cache cleared, " + std::to_wstring(static_cast<unsigned long long>(residentSize)) + L" bytes kept"))
+}
+
+
+template <class T>
+CComPtr<IUnknown> CPluginDomTraverserBase<T>::GetIdentity(IHTMLElement* pEl)
+{
+  // Only the IUnknown pointer is guaranteed to be the same for every
+  // interface pointer to the same element
+  CComPtr<IUnknown> pIdentity;
+  pEl->QueryInterface(IID_IUnknown, (LPVOID*)&pIdentity);
+  return pIdentity;
+}
+
+
+template <class T>
+bool CPluginDomTraverserBase<T>::AreFiltersLoaded()
+{
+  // Gives up waiting eventually, the traversal then goes on without them
+  return WaitForSingleObject(m_tab->m_filter->hideFiltersLoadedEvent, 0) == WAIT_OBJECT_0 ||
+    GetMicroseconds() - m_traversalStart >= ENGINE_STARTUP_TIMEOUT * 1000LL;
+}
+
+
+template <class T>
+bool CPluginDomTraverserBase<T>::ScheduleSlice()
+{
+  // WM_TIMER has the lowest priority, input and painting get handled first
+  UINT_PTR timer = SetTimer(0, 0, USER_TIMER_MINIMUM, OnSliceTimer);
+  if (!timer)
+  {
+    return false;
+  }
+
+  s_criticalSectionSliceTimers.Lock();
+  {
+    s_sliceTimers[timer] = this;
+  }
+  s_criticalSectionSliceTimers.Unlock();
+
+  m_sliceTimer = timer;
+  return true;
+}
+
+
+template <class T>
+void CPluginDomTraverserBase<T>::CancelSlice()
+{
+  if (!m_sliceTimer)
+  {
+    return;
+  }
+
+  KillTimer(0, m_sliceTimer);
+  s_criticalSectionSliceTimers.Lock();
+  {
+    s_sliceTimers.erase(m_sliceTimer);
+  }
+  s_criticalSectionSliceTimers.Unlock();
+
+  m_sliceTimer = 0;
+}
+
+
+template <class T>
+void CALLBACK CPluginDomTraverserBase<T>::OnSliceTimer(HWND hWnd, UINT message, UINT_PTR idEvent, DWORD time)
+{
+  // Timers fire repeatedly, every slice sets a new one
+  KillTimer(0, idEvent);
+
+  CPluginDomTraverserBase<T>* traverser = 0;
+  s_criticalSectionSliceTimers.Lock();
+  {
+    typename std::map<UINT_PTR, CPluginDomTraverserBase<T>*>::iterator it = s_sliceTimers.find(idEvent);
+    if (it != s_sliceTimers.end())
+    {
+      traverser = it->second;
+      s_sliceTimers.erase(it);
+    }
+  }
+  s_criticalSectionSliceTimers.Unlock();
+
+  if (traverser)
+  {
+    traverser->m_sliceTimer = 0;
+    traverser->ContinueTraversal();
+  }
+}
+
+
+template <class T>
+long long CPluginDomTraverserBase<T>::GetMicroseconds()
+{
+  LARGE_INTEGER frequency;
+  LARGE_INTEGER counter;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&counter);
+  return counter.QuadPart / frequency.QuadPart * 1000000 + counter.QuadPart % frequency.QuadPart * 1000000 / frequency.QuadPart;
 }
 
 
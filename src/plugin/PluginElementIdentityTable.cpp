@@ -0,0 +1,101 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PluginElementIdentityTable.h"
+
+namespace
+{
+  const size_t INITIAL_SLOTS = 1024;
+
+  size_t Hash(const void* identity)
+  {
+    // The lower bits of heap addresses are mostly zero
+    uintptr_t address = reinterpret_cast<uintptr_t>(identity);
+    return static_cast<size_t>((address >> 4) ^ (address >> 16)) * 2654435761u;
+  }
+}
+
+// ============================================================================
+// ElementIdentityTable
+// ============================================================================
+
+ElementIdentityTable::ElementIdentityTable()
+  : m_slots(INITIAL_SLOTS), m_size(0), m_generation(1)
+{
+}
+
+size_t ElementIdentityTable::GetSlot(const void* identity) const
+{
+  // Slots of older generations are free, the table never gets more than
+  // half full so there always is one
+  size_t mask = m_slots.size() - 1;
+  size_t slot = Hash(identity) & mask;
+  while (m_slots[slot].generation == m_generation && m_slots[slot].identity != identity)
+  {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+int ElementIdentityTable::Find(const void* identity) const
+{
+  const Slot& slot = m_slots[GetSlot(identity)];
+  return slot.generation == m_generation ? slot.value : -1;
+}
+
+void ElementIdentityTable::Insert(const void* identity, int value)
+{
+  Slot* slot = &m_slots[GetSlot(identity)];
+  if (slot->generation != m_generation)
+  {
+    if ((m_size + 1) * 2 > m_slots.size())
+    {
+      Grow();
+      slot = &m_slots[GetSlot(identity)];
+    }
+    slot->identity = identity;
+    slot->generation = m_generation;
+    m_size++;
+  }
+  slot->value = value;
+}
+
+void ElementIdentityTable::Clear()
+{
+  m_size = 0;
+  if (++m_generation == 0)
+  {
+    // Slots written 2^32 generations ago would look current again
+    std::vector<Slot>(INITIAL_SLOTS).swap(m_slots);
+    m_generation = 1;
+  }
+}
+
+void ElementIdentityTable::Grow()
+{
+  std::vector<Slot> slots(m_slots.size() * 2);
+  slots.swap(m_slots);
+  uint32_t generation = m_generation;
+  for (size_t i = 0; i < slots.size(); i++)
+  {
+    if (slots[i].generation == generation)
+    {
+      Slot& slot = m_slots[GetSlot(slots[i].identity)];
+      slot = slots[i];
+    }
+  }
+}
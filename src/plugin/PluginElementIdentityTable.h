@@ -0,0 +1,66 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PLUGIN_ELEMENT_IDENTITY_TABLE_H_
+#define _PLUGIN_ELEMENT_IDENTITY_TABLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// ============================================================================
+// ElementIdentityTable
+// ============================================================================
+
+// Maps elements, identified by the pointer QueryInterface(IID_IUnknown)
+// returns for them, to an int. Lets the traversal remember the elements it
+// has visited without writing to the DOM. Open addressing with slots stamped
+// with the generation they were written in, Clear() only starts a new
+// generation. The caller has to keep the elements alive as long as they are
+// in the table, otherwise a new element could reuse an address.
+class ElementIdentityTable
+{
+public:
+  ElementIdentityTable();
+
+  // Returns -1 if the element isn't in the table
+  int Find(const void* identity) const;
+  void Insert(const void* identity, int value);
+  void Clear();
+
+  size_t GetSize() const
+  {
+    return m_size;
+  }
+
+private:
+  struct Slot
+  {
+    const void* identity;
+    int value;
+    uint32_t generation;
+  };
+
+  size_t GetSlot(const void* identity) const;
+  void Grow();
+
+  std::vector<Slot> m_slots;
+  size_t m_size;
+  uint32_t m_generation;
+};
+
+#endif // _PLUGIN_ELEMENT_IDENTITY_TABLE_H_
@@ -0,0 +1,127 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PluginElementSnapshot.h"
+
+#include <algorithm>
+#include <cwctype>
+
+// ============================================================================
+// ElementSnapshot
+// ============================================================================
+
+ElementSnapshot::ElementSnapshot(const ElementView& element)
+  : m_element(element), m_fetched(0), m_hasStyle(false)
+{
+}
+
+ElementSnapshot::ElementSnapshot(const ElementView& element, const std::wstring& tagName)
+  : m_element(element), m_fetched(FIELD_TAG_NAME), m_tagName(tagName), m_hasStyle(false)
+{
+}
+
+// Returns true if the field still has to be fetched and marks it as fetched
+bool ElementSnapshot::Fetch(Field field) const
+{
+  if (m_fetched & field)
+  {
+    return false;
+  }
+  m_fetched |= field;
+  return true;
+}
+
+const std::wstring& ElementSnapshot::GetTagName() const
+{
+  if (Fetch(FIELD_TAG_NAME))
+  {
+    m_tagName = m_element.GetTagName();
+  }
+  return m_tagName;
+}
+
+const std::wstring& ElementSnapshot::GetId() const
+{
+  if (Fetch(FIELD_ID))
+  {
+    m_id = m_element.GetId();
+  }
+  return m_id;
+}
+
+const std::wstring& ElementSnapshot::GetClassName() const
+{
+  if (Fetch(FIELD_CLASS_NAME))
+  {
+    m_className = m_element.GetClassName();
+  }
+  return m_className;
+}
+
+const std::wstring* ElementSnapshot::GetStyle() const
+{
+  if (Fetch(FIELD_STYLE))
+  {
+    m_hasStyle = m_element.GetStyle(m_style);
+    std::transform(m_style.begin(), m_style.end(), m_style.begin(), ::towlower);
+  }
+  return m_hasStyle ? &m_style : 0;
+}
+
+const std::wstring* ElementSnapshot::GetAttribute(const std::wstring& name) const
+{
+  std::vector<Attribute>::const_iterator it = m_attributes.begin();
+  while (it != m_attributes.end() && it->name != name)
+  {
+    ++it;
+  }
+  if (it == m_attributes.end())
+  {
+    Attribute attribute;
+    attribute.name = name;
+    attribute.isFound = m_element.GetAttribute(name, attribute.value);
+    m_attributes.push_back(attribute);
+    it = m_attributes.end() - 1;
+  }
+  return it->isFound ? &it->value : 0;
+}
+
+const ElementSnapshot* ElementSnapshot::GetParent() const
+{
+  if (Fetch(FIELD_PARENT))
+  {
+    m_parentView = m_element.GetParent();
+    if (m_parentView)
+    {
+      m_parent.reset(new ElementSnapshot(*m_parentView));
+    }
+  }
+  return m_parent.get();
+}
+
+const ElementSnapshot* ElementSnapshot::GetPreviousSibling() const
+{
+  if (Fetch(FIELD_PREVIOUS_SIBLING))
+  {
+    m_previousSiblingView = m_element.GetPreviousSibling();
+    if (m_previousSiblingView)
+    {
+      m_previousSibling.reset(new ElementSnapshot(*m_previousSiblingView));
+    }
+  }
+  return m_previousSibling.get();
+}
@@ -0,0 +1,94 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PLUGIN_ELEMENT_SNAPSHOT_H_
+#define _PLUGIN_ELEMENT_SNAPSHOT_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "PluginElementView.h"
+
+// ============================================================================
+// ElementSnapshot
+// ============================================================================
+
+// Memoizes what selectors read from an element, so that each property is
+// fetched from the ElementView at most once no matter how many selectors are
+// tried. Properties are only fetched when first asked for. Parent and
+// previous sibling are snapshotted the same way.
+class ElementSnapshot
+{
+public:
+  explicit ElementSnapshot(const ElementView& element);
+  // For callers that already know the lower case tag name
+  ElementSnapshot(const ElementView& element, const std::wstring& tagName);
+
+  const std::wstring& GetTagName() const;
+  const std::wstring& GetId() const;
+  const std::wstring& GetClassName() const;
+  // Lower case inline style, null if the element has none
+  const std::wstring* GetStyle() const;
+  // Null if the element doesn't have the attribute
+  const std::wstring* GetAttribute(const std::wstring& name) const;
+
+  // Null if there is no such element
+  const ElementSnapshot* GetParent() const;
+  const ElementSnapshot* GetPreviousSibling() const;
+
+private:
+  enum Field
+  {
+    FIELD_TAG_NAME = 1,
+    FIELD_ID = 2,
+    FIELD_CLASS_NAME = 4,
+    FIELD_STYLE = 8,
+    FIELD_PARENT = 16,
+    FIELD_PREVIOUS_SIBLING = 32
+  };
+
+  struct Attribute
+  {
+    std::wstring name;
+    std::wstring value;
+    bool isFound;
+  };
+
+  bool Fetch(Field field) const;
+
+  const ElementView& m_element;
+  mutable unsigned int m_fetched;
+
+  mutable std::wstring m_tagName;
+  mutable std::wstring m_id;
+  mutable std::wstring m_className;
+  mutable std::wstring m_style;
+  mutable bool m_hasStyle;
+  mutable std::vector<Attribute> m_attributes;
+
+  // The views have to outlive the snapshots referring to them
+  mutable std::unique_ptr<ElementView> m_parentView;
+  mutable std::unique_ptr<ElementView> m_previousSiblingView;
+  mutable std::unique_ptr<ElementSnapshot> m_parent;
+  mutable std::unique_ptr<ElementSnapshot> m_previousSibling;
+
+  ElementSnapshot(const ElementSnapshot&);
+  ElementSnapshot& operator=(const ElementSnapshot&);
+};
+
+#endif // _PLUGIN_ELEMENT_SNAPSHOT_H_
@@ -0,0 +1,54 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PLUGIN_ELEMENT_VIEW_H_
+#define _PLUGIN_ELEMENT_VIEW_H_
+
+#include <memory>
+#include <string>
+
+// ============================================================================
+// ElementView
+// ============================================================================
+
+// Read-only view of a DOM element, as far as element hiding selectors need
+// it. Implemented on top of MSHTML by MshtmlElementView and by an in-memory
+// DOM in the tests and benchmarks.
+class ElementView
+{
+public:
+  virtual ~ElementView()
+  {
+  }
+
+  // Lower case tag name
+  virtual std::wstring GetTagName() const = 0;
+  // Empty if the element has no id
+  virtual std::wstring GetId() const = 0;
+  // Space separated class names, empty if the element has none
+  virtual std::wstring GetClassName() const = 0;
+  // Returns false if the element has no inline style
+  virtual bool GetStyle(std::wstring& cssText) const = 0;
+  // Returns false if the element doesn't have the attribute
+  virtual bool GetAttribute(const std::wstring& name, std::wstring& value) const = 0;
+
+  // Return null if there is no such element
+  virtual std::unique_ptr<ElementView> GetParent() const = 0;
+  virtual std::unique_ptr<ElementView> GetPreviousSibling() const = 0;
+};
+
+#endif // _PLUGIN_ELEMENT_VIEW_H_
@@ -20,73 +20,11 @@
 
 
 #include "PluginTypedef.h"
+#include "PluginFilterElementHide.h"
+#include "../shared/CriticalSection.h"
 #include <memory>
 
-enum CFilterElementHideAttrPos
-{
-  POS_NONE = 0, STARTING, ENDING, ANYWHERE, EXACT
-};
-
-enum CFilterElementHideAttrType
-{
-  TYPE_NONE = 0, STYLE, ID, CLASS
-};
-// ============================================================================
-// CFilterElementHideAttrSelector
-// ============================================================================
-
-class CFilterElementHideAttrSelector
-{
-
-public:
-
-  CFilterElementHideAttrPos m_pos;
-
-  CFilterElementHideAttrType m_type;
-
-  CComBSTR m_bstrAttr;
-  CString m_value;
-
-  CFilterElementHideAttrSelector();
-  CFilterElementHideAttrSelector(const CFilterElementHideAttrSelector& filter);
-  ~CFilterElementHideAttrSelector();
-};
-
-
-
-// ============================================================================
-// CFilterElementHide
-// ============================================================================
-class CFilterElementHide
-{
-
-public:
-
-  enum ETraverserComplexType
-  {
-    TRAVERSER_TYPE_PARENT,
-    TRAVERSER_TYPE_IMMEDIATE,
-    TRAVERSER_TYPE_ERROR
-  };
-
-
-  CString m_filterText;
-
-  // For domain specific filters only
-  CString m_tagId;
-  CString m_tagClassName;
-  CString m_tag;
-
-  std::vector<CFilterElementHideAttrSelector> m_attributeSelectors;
-  std::shared_ptr<CFilterElementHide> m_predecessor;
-
-  CFilterElementHide(const CString& filterText="");
-  CFilterElementHide(const CFilterElementHide& filter);
-  ETraverserComplexType m_type;
-
-  bool IsMatchFilterElementHide(IHTMLElement* pEl) const;
-
-};
+struct SourceDescription;
 
 // ============================================================================
 // CFilter
@@ -154,17 +92,6 @@ private:
   typedef std::map<DWORD, CFilter> TFilterMap;
   typedef std::vector<CFilter> TFilterMapDefault;
 
-  // (Tag,Name) -> Filter
-  typedef std::multimap<std::pair<CString,CString>, CFilterElementHide> TFilterElementHideTagsNamed;
-
-  // Tag -> Filter
-  typedef std::multimap<CString, CFilterElementHide> TFilterElementHideTags;
-
-
-  TFilterElementHideTagsNamed m_elementHideTagsId;
-  TFilterElementHideTagsNamed m_elementHideTagsClass;
-  TFilterElementHideTags m_elementHideTags;
-
   TFilterMap m_filterMap[2][2];
   TFilterMapDefault m_filterMapDefault[2];
 
@@ -172,19 +99,67 @@ private:
 
 public:
 
-  CPluginFilter(const CString& dataPath = "");
+  // The compiled element hiding filters. A published snapshot never changes,
+  // readers look up in it without a lock while the next one is being built.
+  struct ElementHideSnapshot
+  {
+    std::shared_ptr<const CElementHideMatcher> elementHide;
+    // Shared generic selectors and those of them that don't apply here
+    std::shared_ptr<const CElementHideMatcher> genericElementHide;
+    std::set<std::wstring> excludedSelectors;
+  };
 
-  bool LoadHideFilters(std::vector<std::wstring> filters);
+  CPluginFilter(const CString& dataPath = "");
 
-  bool AddFilterElementHide(CString filter);
+  // IsElementHidden() also considers the selectors of the generic filter,
+  // except for the excluded ones. Both parts are published together, lookups
+  // never see the selectors of one with the generic ones of another call.
+  bool LoadHideFilters(std::vector<std::wstring> filters,
+    std::shared_ptr<const CPluginFilter> genericFilter = std::shared_ptr<const CPluginFilter>(),
+    const std::vector<std::wstring>& excludedSelectors = std::vector<std::wstring>());
 
+  // Element hiding rules of this filter and the generic one that a document's
+  // traversal has to check, see CElementHideMatcher::KeepAll()
+  struct DocumentRules
+  {
+    DocumentRules() : includesCssSelectors(true)
+    {
+    }
+
+    CElementHideMatcher::ActiveRules rules;
+    CElementHideMatcher::ActiveRules genericRules;
+    // The snapshot the rules were selected from, IsElementHidden() keeps
+    // using it even if newer filters have been loaded since
+    std::shared_ptr<const ElementHideSnapshot> snapshot;
+    bool includesCssSelectors;
+  };
 
-  bool IsElementHidden(const std::wstring& tag, IHTMLElement* pEl, const std::wstring& domain, const std::wstring& indent) const;
+  // The selectors of the style sheets are left out unless included
+  void SelectElementHideRules(DocumentRules& rules, bool includeCssSelectors = true) const;
+  // Style sheets hiding what the selectors CSS can express match, see
+  // BuildHidingStyleSheets()
+  std::vector<std::wstring> GetHidingStyleSheets() const;
+  // The document rules are optional
+  bool IsElementHidden(const ElementSnapshot& element, const AncestorFilter* ancestors, const DocumentRules* rules,
+    const std::wstring& domain, const std::wstring& indent) const;
 
 
   bool ShouldBlock(const std::wstring& src, int contentType, const std::wstring& domain, bool addDebug=false) const;
+  std::vector<bool> ShouldBlock(const std::vector<SourceDescription>& sources, const std::wstring& domain) const;
+
+  // The current element hiding filters, safe to call from any thread
+  std::shared_ptr<const ElementHideSnapshot> GetElementHideSnapshot() const;
 
   HANDLE hideFiltersLoadedEvent;
+
+private:
+
+  void PublishElementHideSnapshot(std::shared_ptr<const ElementHideSnapshot> snapshot);
+
+  // Only replaced through std::atomic_load() and std::atomic_store()
+  std::shared_ptr<const ElementHideSnapshot> m_elementHideSnapshot;
+  // Serializes the writers, readers never wait for it
+  CriticalSection m_elementHideWriteLock;
 };
 
 
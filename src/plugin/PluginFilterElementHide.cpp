@@ -0,0 +1,1193 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PluginFilterElementHide.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cwctype>
+#include <exception>
+#include <stdexcept>
+#include <system_error>
+#include <thread>
+
+// The filters are described at http://adblockplus.org/en/filters
+
+namespace
+{
+  std::runtime_error ParseError(const std::wstring& filterText, const char* reason)
+  {
+    std::string message = "Filter::Error parsing selector:";
+    for (std::wstring::const_iterator it = filterText.begin(); it != filterText.end(); ++it)
+    {
+      message += *it < 0x80 ? static_cast<char>(*it) : '?';
+    }
+    return std::runtime_error(message + reason);
+  }
+
+  std::wstring ToLower(std::wstring str)
+  {
+    std::transform(str.begin(), str.end(), str.begin(), ::towlower);
+    return str;
+  }
+
+  std::wstring TrimLeft(const std::wstring& str)
+  {
+    size_t begin = str.find_first_not_of(L" \t\n\r");
+    return begin == std::wstring::npos ? std::wstring() : str.substr(begin);
+  }
+
+  std::wstring TrimRight(const std::wstring& str)
+  {
+    size_t end = str.find_last_not_of(L" \t\n\r");
+    return end == std::wstring::npos ? std::wstring() : str.substr(0, end + 1);
+  }
+
+  bool IsClassNameSeparator(wchar_t c)
+  {
+    return c == L' ' || c == L'\t' || c == L'\n' || c == L'\r';
+  }
+
+  Atom InternAtom(AtomTable& atoms, const std::wstring& str)
+  {
+    return atoms.Intern(str.c_str(), str.size());
+  }
+
+  // Splits e.g. "ad.wide" into its class names
+  std::vector<std::wstring> SplitClassNames(const std::wstring& filterText, const std::wstring& classNames)
+  {
+    std::vector<std::wstring> result;
+    for (size_t begin = 0; ; )
+    {
+      size_t end = classNames.find(L'.', begin);
+      if (end == std::wstring::npos)
+      {
+        end = classNames.size();
+      }
+      if (end == begin)
+      {
+        throw ParseError(filterText, " (empty class name)");
+      }
+      result.push_back(classNames.substr(begin, end - begin));
+      if (end == classNames.size())
+      {
+        return result;
+      }
+      begin = end + 1;
+    }
+  }
+
+  bool HasClass(const AtomTable& atoms, const std::wstring& classNames, Atom classAtom)
+  {
+    const wchar_t* classNamesEnd = classNames.c_str() + classNames.size();
+    for (const wchar_t* className = classNames.c_str(); className != classNamesEnd; )
+    {
+      const wchar_t* classNameEnd = std::find_if(className, classNamesEnd, IsClassNameSeparator);
+      if (atoms.Equals(classAtom, className, classNameEnd - className))
+      {
+        return true;
+      }
+      className = classNameEnd == classNamesEnd ? classNameEnd : classNameEnd + 1;
+    }
+    return false;
+  }
+
+  // Returns the end of the compound selector starting at pos. Attribute
+  // selectors may contain whitespace and combinator characters, these are
+  // skipped.
+  size_t FindCompoundEnd(const std::wstring& selector, size_t pos)
+  {
+    wchar_t quote = L'\0';
+    bool isAttribute = false;
+    for (; pos < selector.size(); pos++)
+    {
+      wchar_t c = selector[pos];
+      if (quote)
+      {
+        if (c == quote)
+          quote = L'\0';
+      }
+      else if (isAttribute)
+      {
+        if (c == L'"' || c == L'\'')
+          quote = c;
+        else if (c == L']')
+          isAttribute = false;
+      }
+      else if (c == L'[')
+      {
+        isAttribute = true;
+      }
+      else if (IsClassNameSeparator(c) || c == L'>' || c == L'+')
+      {
+        break;
+      }
+    }
+    return pos;
+  }
+
+  // At most this many hashes are checked against the ancestor filter
+  const size_t MAX_ANCESTOR_HASHES = 4;
+
+  // Versions are unique across matchers, so that active rules can't be
+  // mistaken for those of a matcher allocated at the same address
+  std::atomic<uint32_t> lastMatcherVersion(0);
+
+  // Accepts the rules whose selector isn't dropped
+  class KeptRule
+  {
+  public:
+    explicit KeptRule(const std::vector<bool>& droppedSelectors) : m_droppedSelectors(droppedSelectors)
+    {
+    }
+
+    template<typename Rule>
+    bool operator()(Atom, Atom, const Rule& rule) const
+    {
+      return !m_droppedSelectors[rule.selector];
+    }
+
+  private:
+    const std::vector<bool>& m_droppedSelectors;
+  };
+
+  // Moves the rules of a merged matcher to the atoms, program and selectors
+  // of the matcher they are merged into
+  class MergedRule
+  {
+  public:
+    MergedRule(const std::vector<Atom>& atoms, uint32_t programOffset, uint32_t selectorOffset)
+      : m_atoms(atoms), m_programOffset(programOffset), m_selectorOffset(selectorOffset)
+    {
+    }
+
+    template<typename Rule>
+    void operator()(Atom& tag, Atom& name, Rule& rule) const
+    {
+      tag = m_atoms[tag];
+      name = m_atoms[name];
+      rule.program += m_programOffset;
+      rule.selector += m_selectorOffset;
+    }
+
+  private:
+    const std::vector<Atom>& m_atoms;
+    uint32_t m_programOffset;
+    uint32_t m_selectorOffset;
+  };
+
+  // Fewer selectors aren't worth starting a thread for
+  const size_t MIN_SELECTORS_PER_THREAD = 1024;
+
+  // The selectors one thread compiles in AddSelectors()
+  struct SelectorPart
+  {
+    CElementHideMatcher* matcher;
+    size_t begin;
+    size_t end;
+    std::vector<std::wstring> failed;
+    // Rethrown on the calling thread, nothing may escape a worker thread
+    std::exception_ptr error;
+  };
+
+  void CompileSelectors(const std::vector<std::wstring>* selectors, SelectorPart* part)
+  {
+    for (size_t i = part->begin; i < part->end; i++)
+    {
+      try
+      {
+        part->matcher->AddSelector((*selectors)[i]);
+      }
+      catch (const std::exception&)
+      {
+        part->failed.push_back((*selectors)[i]);
+      }
+      catch (...)
+      {
+        part->error = std::current_exception();
+        return;
+      }
+    }
+  }
+
+  bool IsCssName(const std::wstring& name)
+  {
+    for (std::wstring::const_iterator it = name.begin(); it != name.end(); ++it)
+    {
+      if (*it < 0x80 && !isalnum(*it) && *it != L'-' && *it != L'_')
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Returns true if a style sheet hides the same elements as Run(). Run()
+  // compares style attributes with the cssText IE rearranges, and names with
+  // unusual characters may be parsed differently by IE.
+  bool IsCssExpressible(const CFilterElementHide& filter)
+  {
+    for (const CFilterElementHide* current = &filter; current; current = current->m_predecessor.get())
+    {
+      if (!IsCssName(current->m_tag) || !IsCssName(current->m_tagId))
+      {
+        return false;
+      }
+      for (std::vector<std::wstring>::const_iterator it = current->m_tagClassNames.begin();
+           it != current->m_tagClassNames.end(); ++it)
+      {
+        if (!IsCssName(*it))
+        {
+          return false;
+        }
+      }
+      for (std::vector<CFilterElementHideAttrSelector>::const_iterator it = current->m_attributeSelectors.begin();
+           it != current->m_attributeSelectors.end(); ++it)
+      {
+        if (it->m_type == STYLE || !IsCssName(it->m_attr))
+        {
+          return false;
+        }
+        // Values other than names have to be quoted
+        if (!IsCssName(it->m_value) && current->m_filterText.find(L'"' + it->m_value + L'"') == std::wstring::npos)
+        {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+}
+
+// ============================================================================
+// CFilterElementHideAttrSelector
+// ============================================================================
+
+CFilterElementHideAttrSelector::CFilterElementHideAttrSelector() : m_pos(POS_NONE), m_type(TYPE_NONE)
+{
+}
+
+
+// ============================================================================
+// CFilterElementHide
+// ============================================================================
+
+CFilterElementHide::CFilterElementHide(const std::wstring& filterText) : m_filterText(filterText), m_type(TRAVERSER_TYPE_ERROR)
+{
+  // Find tag name, class or any (*)
+  std::wstring filterString = filterText;
+
+  wchar_t firstTag = filterString.empty() ? L'\0' : filterString[0];
+  // Any tag
+  if (firstTag == '*')
+  {
+    filterString = filterString.substr(1);
+  }
+  // Any tag (implicitely)
+  else if (firstTag == '[' || firstTag == '.' || firstTag == '#')
+  {
+  }
+  // Real tag
+  else if (firstTag < 0x80 && isalnum(firstTag))
+  {
+    size_t pos = filterString.find_first_of(L".#[(");
+
+    if (pos == std::wstring::npos)
+      pos = filterString.size();
+    m_tag = ToLower(filterString.substr(0, pos));
+
+    filterString = filterString.substr(pos);
+  }
+  // Error
+  else
+  {
+    throw ParseError(filterText, " (invalid tag)");
+  }
+
+  // Find Id and class name
+
+  if (!filterString.empty())
+  {
+    wchar_t firstId = filterString[0];
+
+    // Id
+    if (firstId == '#')
+    {
+      size_t pos = filterString.find('[');
+      if (pos == std::wstring::npos)
+      {
+        pos = filterString.size();
+      }
+      m_tagId = filterString.substr(1, pos - 1);
+      filterString = filterString.substr(pos);
+      pos = m_tagId.find(L'.');
+      if (pos != std::wstring::npos && pos > 0)
+      {
+        m_tagClassNames = SplitClassNames(filterText, m_tagId.substr(pos + 1));
+        m_tagId = m_tagId.substr(0, pos);
+      }
+    }
+    // Class name
+    else if (firstId == '.')
+    {
+      size_t pos = filterString.find('[');
+      if (pos == std::wstring::npos)
+      {
+        pos = filterString.size();
+      }
+      m_tagClassNames = SplitClassNames(filterText, filterString.substr(1, pos - 1));
+      filterString = filterString.substr(pos);
+    }
+  }
+
+  wchar_t chAttrStart = '[';
+  wchar_t chAttrEnd   = ']';
+
+  while (!filterString.empty())
+  {
+    if (filterString[0] != chAttrStart)
+    {
+      throw ParseError(filterText, " (more data)");
+    }
+    size_t endPos = filterString.find(chAttrEnd);
+    if (endPos == std::wstring::npos)
+    {
+      throw ParseError(filterText, " (more data)");
+    }
+
+    CFilterElementHideAttrSelector attrSelector;
+
+    std::wstring arg = filterString.substr(1, endPos - 1);
+    filterString = filterString.substr(endPos + 1);
+
+    size_t delimiterPos = arg.find('=');
+    if (delimiterPos != std::wstring::npos && delimiterPos > 0)
+    {
+      attrSelector.m_value = arg.substr(delimiterPos + 1);
+      if (attrSelector.m_value.size() >= 2 && attrSelector.m_value[0] == '\"' && attrSelector.m_value[attrSelector.m_value.size() - 1] == '\"')
+      {
+        attrSelector.m_value = attrSelector.m_value.substr(1, attrSelector.m_value.size() - 2);
+      }
+
+      if (arg[delimiterPos - 1] == '^')
+      {
+        attrSelector.m_attr = arg.substr(0, delimiterPos - 1);
+        attrSelector.m_pos = STARTING;
+      }
+      else if (arg[delimiterPos - 1] == '*')
+      {
+        attrSelector.m_attr = arg.substr(0, delimiterPos - 1);
+        attrSelector.m_pos = ANYWHERE;
+      }
+      else if (arg[delimiterPos - 1] == '$')
+      {
+        attrSelector.m_attr = arg.substr(0, delimiterPos - 1);
+        attrSelector.m_pos = ENDING;
+      }
+      else
+      {
+        attrSelector.m_attr = arg.substr(0, delimiterPos);
+        attrSelector.m_pos = EXACT;
+      }
+    }
+    else
+    {
+      attrSelector.m_attr = arg;
+    }
+    const std::wstring& tag = attrSelector.m_attr;
+    if (tag == L"style")
+    {
+      attrSelector.m_type = STYLE;
+      attrSelector.m_value = ToLower(attrSelector.m_value);
+    }
+    else if (tag == L"id")
+    {
+      attrSelector.m_type = ID;
+    }
+    else if (tag == L"class")
+    {
+      attrSelector.m_type = CLASS;
+    }
+    m_attributeSelectors.push_back(attrSelector);
+
+  }
+}
+
+
+// ============================================================================
+// CElementHideMatcher
+// ============================================================================
+
+CElementHideMatcher::CElementHideMatcher() : m_version(++lastMatcherVersion)
+{
+}
+
+void CElementHideMatcher::AddSelector(const std::wstring& selector)
+{
+  std::wstring filterText = TrimRight(TrimLeft(selector));
+  std::shared_ptr<CFilterElementHide> filter;
+
+  // Compound selectors from left to right, each one links to the previous one
+  size_t chunkStart = 0;
+  while (true)
+  {
+    size_t chunkEnd = FindCompoundEnd(filterText, chunkStart);
+    std::shared_ptr<CFilterElementHide> filterParent(filter);
+
+    filter.reset(new CFilterElementHide(filterText.substr(chunkStart, chunkEnd - chunkStart)));
+    filter->m_predecessor = filterParent;
+
+    if (chunkEnd == filterText.size()) // Terminating element (simple selector)
+    {
+      break;
+    }
+
+    // Complex selector, whitespace alone is the descendant combinator
+    size_t next = filterText.find_first_not_of(L" \t\n\r", chunkEnd);
+    filter->m_type = CFilterElementHide::TRAVERSER_TYPE_DESCENDANT;
+    if (filterText[next] == L'+' || filterText[next] == L'>')
+    {
+      filter->m_type = filterText[next] == L'+' ?
+        CFilterElementHide::TRAVERSER_TYPE_IMMEDIATE : CFilterElementHide::TRAVERSER_TYPE_PARENT;
+      next = filterText.find_first_not_of(L" \t\n\r", next + 1);
+      if (next == std::wstring::npos)
+      {
+        throw ParseError(selector, " (missing element)");
+      }
+    }
+    chunkStart = next;
+  }
+
+  filter->m_selector = selector;
+
+  // Only the terminating element's class names end up in m_classAtoms
+  uint32_t classAtomsStart = static_cast<uint32_t>(m_classAtoms.size());
+  Rule rule;
+  rule.program = Compile(*filter);
+  rule.selector = static_cast<uint32_t>(m_selectors.size());
+  m_selectors.push_back(selector);
+  m_cssSelectors.push_back(IsCssExpressible(*filter));
+
+  Atom tag = InternAtom(m_atoms, filter->m_tag);
+  if (!filter->m_tagId.empty())
+  {
+    m_elementHideTagsId.Add(tag, InternAtom(m_atoms, filter->m_tagId), rule);
+  }
+  else if (!filter->m_tagClassNames.empty())
+  {
+    Atom classAtom = AtomTable::EMPTY_ATOM;
+    for (std::vector<std::wstring>::const_iterator it = filter->m_tagClassNames.begin();
+         it != filter->m_tagClassNames.end(); ++it)
+    {
+      classAtom = InternAtom(m_atoms, *it);
+      if (classAtom >= m_classFrequencies.size())
+      {
+        m_classFrequencies.resize(classAtom + 1, 0);
+      }
+      m_classFrequencies[classAtom]++;
+    }
+
+    if (filter->m_tagClassNames.size() == 1)
+    {
+      m_elementHideTagsClass.Add(tag, classAtom, rule);
+    }
+    else
+    {
+      // The key is chosen once the frequencies of the whole list are known
+      MultiClassRule multiClassRule;
+      multiClassRule.tag = tag;
+      multiClassRule.classes = classAtomsStart;
+      multiClassRule.classCount = static_cast<uint32_t>(m_classAtoms.size() - classAtomsStart);
+      multiClassRule.rule = rule;
+      m_pendingMultiClassRules.push_back(multiClassRule);
+    }
+  }
+  else
+  {
+    m_elementHideTags.Add(tag, AtomTable::EMPTY_ATOM, rule);
+  }
+}
+
+std::vector<std::wstring> CElementHideMatcher::AddSelectors(const std::vector<std::wstring>& selectors, size_t threadCount)
+{
+  size_t partCount = std::max<size_t>(std::min<size_t>(threadCount, selectors.size() / MIN_SELECTORS_PER_THREAD), 1);
+
+  // The first part is compiled into this matcher on the calling thread
+  std::vector<std::unique_ptr<CElementHideMatcher> > matchers;
+  std::vector<SelectorPart> parts(partCount);
+  for (size_t i = 0; i < partCount; i++)
+  {
+    parts[i].begin = selectors.size() * i / partCount;
+    parts[i].end = selectors.size() * (i + 1) / partCount;
+    parts[i].matcher = this;
+    if (i > 0)
+    {
+      matchers.push_back(std::unique_ptr<CElementHideMatcher>(new CElementHideMatcher()));
+      parts[i].matcher = matchers.back().get();
+    }
+  }
+
+  std::vector<std::thread> threads;
+  for (size_t i = 1; i < partCount; i++)
+  {
+    try
+    {
+      threads.push_back(std::thread(CompileSelectors, &selectors, &parts[i]));
+    }
+    catch (const std::system_error&)
+    {
+      break;
+    }
+  }
+  CompileSelectors(&selectors, &parts[0]);
+  // The parts no thread could be started for
+  for (size_t i = threads.size() + 1; i < partCount; i++)
+  {
+    CompileSelectors(&selectors, &parts[i]);
+  }
+  for (size_t i = 0; i < threads.size(); i++)
+  {
+    threads[i].join();
+  }
+  for (size_t i = 0; i < partCount; i++)
+  {
+    if (parts[i].error)
+    {
+      std::rethrow_exception(parts[i].error);
+    }
+  }
+
+  std::vector<std::wstring> failed(parts[0].failed);
+  for (size_t i = 1; i < partCount; i++)
+  {
+    Merge(*parts[i].matcher);
+    failed.insert(failed.end(), parts[i].failed.begin(), parts[i].failed.end());
+  }
+  return failed;
+}
+
+void CElementHideMatcher::Merge(const CElementHideMatcher& other)
+{
+  // Atoms and attribute names of the other matcher mapped to those of this one
+  std::vector<Atom> atoms(other.m_atoms.GetSize() + 1, AtomTable::EMPTY_ATOM);
+  for (Atom atom = 1; atom < atoms.size(); atom++)
+  {
+    size_t length;
+    const wchar_t* str = other.m_atoms.GetString(atom, length);
+    atoms[atom] = m_atoms.Intern(str, length);
+  }
+  std::vector<uint16_t> attributeNames;
+  for (std::vector<std::wstring>::const_iterator it = other.m_attributeNames.begin(); it != other.m_attributeNames.end(); ++it)
+  {
+    std::vector<std::wstring>::const_iterator name = std::find(m_attributeNames.begin(), m_attributeNames.end(), *it);
+    if (name == m_attributeNames.end())
+    {
+      if (m_attributeNames.size() > 0xFFFF)
+      {
+        throw std::runtime_error("Filter::Too many attribute names");
+      }
+      m_attributeNames.push_back(*it);
+      name = m_attributeNames.end() - 1;
+    }
+    attributeNames.push_back(static_cast<uint16_t>(name - m_attributeNames.begin()));
+  }
+
+  uint32_t programOffset = static_cast<uint32_t>(m_program.size());
+  uint32_t stringsOffset = static_cast<uint32_t>(m_strings.size());
+  uint32_t hashesOffset = static_cast<uint32_t>(m_ancestorHashes.size());
+  uint32_t classAtomsOffset = static_cast<uint32_t>(m_classAtoms.size());
+  uint32_t selectorOffset = static_cast<uint32_t>(m_selectors.size());
+
+  m_strings.insert(m_strings.end(), other.m_strings.begin(), other.m_strings.end());
+  m_ancestorHashes.insert(m_ancestorHashes.end(), other.m_ancestorHashes.begin(), other.m_ancestorHashes.end());
+  for (std::vector<Atom>::const_iterator it = other.m_classAtoms.begin(); it != other.m_classAtoms.end(); ++it)
+  {
+    m_classAtoms.push_back(atoms[*it]);
+  }
+  m_selectors.insert(m_selectors.end(), other.m_selectors.begin(), other.m_selectors.end());
+  m_cssSelectors.insert(m_cssSelectors.end(), other.m_cssSelectors.begin(), other.m_cssSelectors.end());
+
+  for (std::vector<SelectorInstruction>::const_iterator it = other.m_program.begin(); it != other.m_program.end(); ++it)
+  {
+    SelectorInstruction instruction = *it;
+    switch (instruction.opcode)
+    {
+    case SelectorInstruction::OP_TAG_EQ:
+    case SelectorInstruction::OP_ID_EQ:
+    case SelectorInstruction::OP_HAS_CLASS:
+      instruction.value = atoms[instruction.value];
+      break;
+    case SelectorInstruction::OP_HAS_CLASSES:
+      {
+        // The class names have to stay sorted by atom
+        instruction.value += classAtomsOffset;
+        std::vector<Atom>::iterator classes = m_classAtoms.begin() + instruction.value;
+        std::sort(classes, classes + instruction.length);
+      }
+      break;
+    case SelectorInstruction::OP_ATTR_EXISTS:
+    case SelectorInstruction::OP_ATTR_EQ:
+    case SelectorInstruction::OP_ATTR_PREFIX:
+    case SelectorInstruction::OP_ATTR_SUFFIX:
+    case SelectorInstruction::OP_ATTR_SUBSTR:
+      instruction.value += stringsOffset;
+      if (instruction.attribute == SelectorInstruction::ATTRIBUTE_NAMED)
+      {
+        instruction.name = attributeNames[instruction.name];
+      }
+      break;
+    case SelectorInstruction::OP_BLOOM_CHECK:
+      instruction.value += hashesOffset;
+      break;
+    default:
+      break;
+    }
+    m_program.push_back(instruction);
+  }
+
+  for (Atom atom = 0; atom < other.m_classFrequencies.size(); atom++)
+  {
+    if (other.m_classFrequencies[atom] > 0)
+    {
+      Atom classAtom = atoms[atom];
+      if (classAtom >= m_classFrequencies.size())
+      {
+        m_classFrequencies.resize(classAtom + 1, 0);
+      }
+      m_classFrequencies[classAtom] += other.m_classFrequencies[atom];
+    }
+  }
+
+  MergedRule mergedRule(atoms, programOffset, selectorOffset);
+  m_elementHideTagsId.AddMapped(other.m_elementHideTagsId, mergedRule);
+  m_elementHideTagsClass.AddMapped(other.m_elementHideTagsClass, mergedRule);
+  m_elementHideTags.AddMapped(other.m_elementHideTags, mergedRule);
+  for (std::vector<MultiClassRule>::const_iterator it = other.m_pendingMultiClassRules.begin();
+       it != other.m_pendingMultiClassRules.end(); ++it)
+  {
+    MultiClassRule multiClassRule = *it;
+    Atom tag = multiClassRule.tag;
+    Atom name = AtomTable::EMPTY_ATOM;
+    mergedRule(tag, name, multiClassRule.rule);
+    multiClassRule.tag = tag;
+    multiClassRule.classes += classAtomsOffset;
+    m_pendingMultiClassRules.push_back(multiClassRule);
+  }
+}
+
+void CElementHideMatcher::Emit(SelectorInstruction::Opcode opcode, uint32_t value)
+{
+  SelectorInstruction instruction;
+  instruction.opcode = static_cast<uint8_t>(opcode);
+  instruction.attribute = SelectorInstruction::ATTRIBUTE_NAMED;
+  instruction.name = 0;
+  instruction.value = value;
+  instruction.length = 0;
+  m_program.push_back(instruction);
+}
+
+void CElementHideMatcher::EmitAttribute(const CFilterElementHideAttrSelector& selector)
+{
+  SelectorInstruction::Opcode opcode = SelectorInstruction::OP_ATTR_EXISTS;
+  switch (selector.m_pos)
+  {
+  case EXACT:
+    opcode = SelectorInstruction::OP_ATTR_EQ;
+    break;
+  case STARTING:
+    opcode = SelectorInstruction::OP_ATTR_PREFIX;
+    break;
+  case ENDING:
+    opcode = SelectorInstruction::OP_ATTR_SUFFIX;
+    break;
+  case ANYWHERE:
+    opcode = SelectorInstruction::OP_ATTR_SUBSTR;
+    break;
+  default:
+    break;
+  }
+  Emit(opcode, static_cast<uint32_t>(m_strings.size()));
+
+  SelectorInstruction& instruction = m_program.back();
+  instruction.length = static_cast<uint32_t>(selector.m_value.size());
+  m_strings.insert(m_strings.end(), selector.m_value.begin(), selector.m_value.end());
+
+  switch (selector.m_type)
+  {
+  case STYLE:
+    instruction.attribute = SelectorInstruction::ATTRIBUTE_STYLE;
+    break;
+  case ID:
+    instruction.attribute = SelectorInstruction::ATTRIBUTE_ID;
+    break;
+  case CLASS:
+    instruction.attribute = SelectorInstruction::ATTRIBUTE_CLASS;
+    break;
+  default:
+    std::vector<std::wstring>::const_iterator it =
+      std::find(m_attributeNames.begin(), m_attributeNames.end(), selector.m_attr);
+    if (it == m_attributeNames.end())
+    {
+      if (m_attributeNames.size() > 0xFFFF)
+      {
+        throw std::runtime_error("Filter::Too many attribute names");
+      }
+      m_attributeNames.push_back(selector.m_attr);
+      it = m_attributeNames.end() - 1;
+    }
+    instruction.name = static_cast<uint16_t>(it - m_attributeNames.begin());
+    break;
+  }
+}
+
+// Compiles the filter and its predecessors, returns the start of the program
+uint32_t CElementHideMatcher::Compile(const CFilterElementHide& filter)
+{
+  uint32_t start = static_cast<uint32_t>(m_program.size());
+
+  // Compound selectors followed by '>' or ' ' have to match ancestors, check
+  // for their tag, id and class name first
+  uint32_t hashesStart = static_cast<uint32_t>(m_ancestorHashes.size());
+  for (const CFilterElementHide* current = filter.m_predecessor.get(); current; current = current->m_predecessor.get())
+  {
+    if (current->m_type != CFilterElementHide::TRAVERSER_TYPE_PARENT &&
+        current->m_type != CFilterElementHide::TRAVERSER_TYPE_DESCENDANT)
+    {
+      continue;
+    }
+    if (!current->m_tagId.empty())
+    {
+      m_ancestorHashes.push_back(AncestorFilter::HashId(current->m_tagId.c_str(), current->m_tagId.size()));
+    }
+    for (std::vector<std::wstring>::const_iterator it = current->m_tagClassNames.begin();
+         it != current->m_tagClassNames.end(); ++it)
+    {
+      m_ancestorHashes.push_back(AncestorFilter::HashClass(it->c_str(), it->size()));
+    }
+    if (!current->m_tag.empty())
+    {
+      m_ancestorHashes.push_back(AncestorFilter::HashTag(current->m_tag.c_str(), current->m_tag.size()));
+    }
+  }
+  if (m_ancestorHashes.size() - hashesStart > MAX_ANCESTOR_HASHES)
+  {
+    m_ancestorHashes.resize(hashesStart + MAX_ANCESTOR_HASHES);
+  }
+  if (m_ancestorHashes.size() > hashesStart)
+  {
+    Emit(SelectorInstruction::OP_BLOOM_CHECK, hashesStart);
+    m_program.back().length = static_cast<uint32_t>(m_ancestorHashes.size() - hashesStart);
+  }
+
+  for (const CFilterElementHide* current = &filter; current; current = current->m_predecessor.get())
+  {
+    // The index lookup already checked the tag and either the id or the
+    // class name of the terminating element
+    bool isTerminating = current == &filter;
+    if (!current->m_tagId.empty() && !isTerminating)
+    {
+      Emit(SelectorInstruction::OP_ID_EQ, InternAtom(m_atoms, current->m_tagId));
+    }
+    if (isTerminating && (current->m_tagClassNames.size() > 1 ||
+        (!current->m_tagId.empty() && !current->m_tagClassNames.empty())))
+    {
+      // Checked against the element's sorted class names
+      std::vector<Atom> classAtoms;
+      for (std::vector<std::wstring>::const_iterator it = current->m_tagClassNames.begin();
+           it != current->m_tagClassNames.end(); ++it)
+      {
+        classAtoms.push_back(InternAtom(m_atoms, *it));
+      }
+      std::sort(classAtoms.begin(), classAtoms.end());
+      classAtoms.erase(std::unique(classAtoms.begin(), classAtoms.end()), classAtoms.end());
+
+      Emit(SelectorInstruction::OP_HAS_CLASSES, static_cast<uint32_t>(m_classAtoms.size()));
+      m_program.back().length = static_cast<uint32_t>(classAtoms.size());
+      m_classAtoms.insert(m_classAtoms.end(), classAtoms.begin(), classAtoms.end());
+    }
+    else if (!isTerminating)
+    {
+      for (std::vector<std::wstring>::const_iterator it = current->m_tagClassNames.begin();
+           it != current->m_tagClassNames.end(); ++it)
+      {
+        Emit(SelectorInstruction::OP_HAS_CLASS, InternAtom(m_atoms, *it));
+      }
+    }
+    if (!current->m_tag.empty() && !isTerminating)
+    {
+      Emit(SelectorInstruction::OP_TAG_EQ, InternAtom(m_atoms, current->m_tag));
+    }
+    for (std::vector<CFilterElementHideAttrSelector>::const_iterator it = current->m_attributeSelectors.begin();
+         it != current->m_attributeSelectors.end(); ++it)
+    {
+      EmitAttribute(*it);
+    }
+
+    if (current->m_predecessor)
+    {
+      switch (current->m_predecessor->m_type)
+      {
+      case CFilterElementHide::TRAVERSER_TYPE_IMMEDIATE:
+        Emit(SelectorInstruction::OP_PREVIOUS_SIBLING);
+        break;
+      case CFilterElementHide::TRAVERSER_TYPE_DESCENDANT:
+        Emit(SelectorInstruction::OP_ANCESTOR);
+        break;
+      default:
+        Emit(SelectorInstruction::OP_PARENT);
+        break;
+      }
+    }
+  }
+  Emit(SelectorInstruction::OP_MATCH);
+  return start;
+}
+
+bool CElementHideMatcher::Run(uint32_t pc, const ElementSnapshot& element, const MatchContext* context) const
+{
+  const ElementSnapshot* current = &element;
+  for (const SelectorInstruction* instruction = &m_program[pc]; ; ++instruction)
+  {
+    switch (instruction->opcode)
+    {
+    case SelectorInstruction::OP_TAG_EQ:
+      {
+        const std::wstring& tag = current->GetTagName();
+        if (!m_atoms.Equals(instruction->value, tag.c_str(), tag.size()))
+          return false;
+      }
+      break;
+    case SelectorInstruction::OP_ID_EQ:
+      {
+        const std::wstring& id = current->GetId();
+        if (!m_atoms.Equals(instruction->value, id.c_str(), id.size()))
+          return false;
+      }
+      break;
+    case SelectorInstruction::OP_HAS_CLASS:
+      if (!HasClass(m_atoms, current->GetClassName(), instruction->value))
+        return false;
+      break;
+    case SelectorInstruction::OP_HAS_CLASSES:
+      if (!HasClasses(*current, instruction->length ? &m_classAtoms[instruction->value] : 0, instruction->length,
+          current == &element ? context : 0))
+        return false;
+      break;
+    case SelectorInstruction::OP_ATTR_EXISTS:
+    case SelectorInstruction::OP_ATTR_EQ:
+    case SelectorInstruction::OP_ATTR_PREFIX:
+    case SelectorInstruction::OP_ATTR_SUFFIX:
+    case SelectorInstruction::OP_ATTR_SUBSTR:
+      {
+        const std::wstring* attribute = 0;
+        switch (instruction->attribute)
+        {
+        case SelectorInstruction::ATTRIBUTE_STYLE:
+          attribute = current->GetStyle();
+          break;
+        case SelectorInstruction::ATTRIBUTE_ID:
+          attribute = current->GetId().empty() ? 0 : &current->GetId();
+          break;
+        case SelectorInstruction::ATTRIBUTE_CLASS:
+          attribute = current->GetClassName().empty() ? 0 : &current->GetClassName();
+          break;
+        default:
+          attribute = current->GetAttribute(m_attributeNames[instruction->name]);
+          break;
+        }
+        if (!attribute)
+          return false;
+
+        const wchar_t* value = instruction->length ? &m_strings[instruction->value] : L"";
+        size_t length = instruction->length;
+        switch (instruction->opcode)
+        {
+        case SelectorInstruction::OP_ATTR_EQ:
+          // TODO: IE rearranges the style attribute completely. Figure out if anything can be done about it.
+          if (attribute->size() != length || attribute->compare(0, length, value, length) != 0)
+            return false;
+          break;
+        case SelectorInstruction::OP_ATTR_PREFIX:
+          if (attribute->size() < length || attribute->compare(0, length, value, length) != 0)
+            return false;
+          break;
+        case SelectorInstruction::OP_ATTR_SUFFIX:
+          if (attribute->size() < length || attribute->compare(attribute->size() - length, length, value, length) != 0)
+            return false;
+          break;
+        case SelectorInstruction::OP_ATTR_SUBSTR:
+          if (attribute->find(value, 0, length) == std::wstring::npos)
+            return false;
+          break;
+        }
+      }
+      break;
+    case SelectorInstruction::OP_PARENT:
+      if (!(current = current->GetParent()))
+        return false;
+      break;
+    case SelectorInstruction::OP_PREVIOUS_SIBLING:
+      if (!(current = current->GetPreviousSibling()))
+        return false;
+      break;
+    case SelectorInstruction::OP_ANCESTOR:
+      {
+        // The rest of the program has to match one of the ancestors
+        uint32_t next = static_cast<uint32_t>(instruction - &m_program[0]) + 1;
+        for (const ElementSnapshot* ancestor = current->GetParent(); ancestor; ancestor = ancestor->GetParent())
+        {
+          if (Run(next, *ancestor, 0))
+            return true;
+        }
+        return false;
+      }
+    case SelectorInstruction::OP_BLOOM_CHECK:
+      if (context && context->ancestors)
+      {
+        const uint32_t* hash = &m_ancestorHashes[instruction->value];
+        for (const uint32_t* hashesEnd = hash + instruction->length; hash != hashesEnd; ++hash)
+        {
+          if (!context->ancestors->MayContain(*hash))
+            return false;
+        }
+      }
+      break;
+    case SelectorInstruction::OP_MATCH:
+      return true;
+    }
+  }
+}
+
+bool CElementHideMatcher::HasClasses(const ElementSnapshot& element, const Atom* classes, size_t classCount,
+  const MatchContext* context) const
+{
+  if (context && context->classes.isComplete)
+  {
+    const ElementClasses& elementClasses = context->classes;
+    return std::includes(elementClasses.atoms, elementClasses.atoms + elementClasses.count, classes, classes + classCount);
+  }
+  for (size_t i = 0; i < classCount; i++)
+  {
+    if (!HasClass(m_atoms, element.GetClassName(), classes[i]))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+
+void CElementHideMatcher::Build()
+{
+  // Rules requiring several class names are found through the class name
+  // fewest selectors require, that one is the least likely to be present
+  for (std::vector<MultiClassRule>::const_iterator it = m_pendingMultiClassRules.begin();
+       it != m_pendingMultiClassRules.end(); ++it)
+  {
+    const Atom* classes = &m_classAtoms[it->classes];
+    Atom rarest = classes[0];
+    for (uint32_t i = 1; i < it->classCount; i++)
+    {
+      if (m_classFrequencies[classes[i]] < m_classFrequencies[rarest])
+      {
+        rarest = classes[i];
+      }
+    }
+    m_elementHideTagsClass.Add(it->tag, rarest, it->rule);
+  }
+  m_pendingMultiClassRules.clear();
+  m_version = ++lastMatcherVersion;
+
+  m_elementHideTagsId.Build();
+  m_elementHideTagsClass.Build();
+  m_elementHideTags.Build();
+}
+
+void CElementHideMatcher::Clear()
+{
+  m_elementHideTags.Clear();
+  m_elementHideTagsId.Clear();
+  m_elementHideTagsClass.Clear();
+  m_atoms.Clear();
+  m_program.clear();
+  m_strings.clear();
+  m_ancestorHashes.clear();
+  m_classAtoms.clear();
+  m_classFrequencies.clear();
+  m_pendingMultiClassRules.clear();
+  m_attributeNames.clear();
+  m_selectors.clear();
+  m_cssSelectors.clear();
+  m_version = ++lastMatcherVersion;
+}
+
+void CElementHideMatcher::GetCssSelectors(const std::set<std::wstring>& excludedSelectors,
+  std::vector<std::wstring>& selectors) const
+{
+  for (size_t i = 0; i < m_selectors.size(); i++)
+  {
+    if (m_cssSelectors[i] && !excludedSelectors.count(m_selectors[i]))
+    {
+      selectors.push_back(m_selectors[i]);
+    }
+  }
+}
+
+void CElementHideMatcher::KeepAll(ActiveRules& rules, bool includeCssSelectors) const
+{
+  rules.m_elementHideTagsId.Clear();
+  rules.m_elementHideTagsClass.Clear();
+  rules.m_elementHideTags.Clear();
+  if (includeCssSelectors)
+  {
+    // Match() doesn't restrict the candidates without active rules
+    rules.m_matcher = 0;
+    rules.m_version = 0;
+    return;
+  }
+  rules.m_elementHideTagsId.AddIf(m_elementHideTagsId, KeptRule(m_cssSelectors));
+  rules.m_elementHideTagsId.Build();
+  rules.m_elementHideTagsClass.AddIf(m_elementHideTagsClass, KeptRule(m_cssSelectors));
+  rules.m_elementHideTagsClass.Build();
+  rules.m_elementHideTags.AddIf(m_elementHideTags, KeptRule(m_cssSelectors));
+  rules.m_elementHideTags.Build();
+  rules.m_matcher = this;
+  rules.m_version = m_version;
+}
+
+const std::wstring* CElementHideMatcher::Match(const TRuleIndex::Range& candidates,
+  const ElementSnapshot& element, const std::set<std::wstring>& excludedSelectors, const MatchContext& context) const
+{
+  for (TRuleIndex::const_iterator it = candidates.first; it != candidates.second; ++it)
+  {
+    const std::wstring& selector = m_selectors[it->selector];
+    if (Run(it->program, element, &context) && !excludedSelectors.count(selector))
+    {
+      return &selector;
+    }
+  }
+  return 0;
+}
+
+const std::wstring* CElementHideMatcher::Match(const ElementSnapshot& element,
+  const std::set<std::wstring>& excludedSelectors, const AncestorFilter* ancestors, const ActiveRules* rules) const
+{
+  bool isRestricted = rules && rules->m_matcher == this && rules->m_version == m_version;
+  const TRuleIndex& elementHideTagsId = isRestricted ? rules->m_elementHideTagsId : m_elementHideTagsId;
+  const TRuleIndex& elementHideTagsClass = isRestricted ? rules->m_elementHideTagsClass : m_elementHideTagsClass;
+  const TRuleIndex& elementHideTags = isRestricted ? rules->m_elementHideTags : m_elementHideTags;
+
+  const std::wstring& tag = element.GetTagName();
+  const std::wstring& id = element.GetId();
+  const std::wstring& classNames = element.GetClassName();
+
+  // Unknown names can't match any filter, FilterIndex::Find() skips them
+  Atom tagAtom = m_atoms.Find(tag.c_str(), tag.size());
+  const std::wstring* selector = 0;
+
+  MatchContext context;
+  context.ancestors = ancestors;
+  ElementClasses& classes = context.classes;
+  classes.count = 0;
+  classes.isComplete = true;
+  const wchar_t* classNamesEnd = classNames.c_str() + classNames.size();
+  for (const wchar_t* className = classNames.c_str(); className != classNamesEnd; )
+  {
+    if (IsClassNameSeparator(*className))
+    {
+      ++className;
+      continue;
+    }
+    const wchar_t* classNameEnd = std::find_if(className, classNamesEnd, IsClassNameSeparator);
+    Atom classAtom = m_atoms.Find(className, classNameEnd - className);
+    if (classAtom != AtomTable::UNKNOWN_ATOM)
+    {
+      if (classes.count == ElementClasses::CAPACITY)
+      {
+        classes.isComplete = false;
+        break;
+      }
+      classes.atoms[classes.count++] = classAtom;
+    }
+
+    // Next class name
+    className = classNameEnd;
+  }
+  std::sort(classes.atoms, classes.atoms + classes.count);
+  classes.count = std::unique(classes.atoms, classes.atoms + classes.count) - classes.atoms;
+
+  // Search tag/id filters, then general id filters
+  if (!id.empty())
+  {
+    Atom idAtom = m_atoms.Find(id.c_str(), id.size());
+    if ((selector = Match(elementHideTagsId.Find(tagAtom, idAtom), element, excludedSelectors, context)) ||
+        (selector = Match(elementHideTagsId.Find(AtomTable::EMPTY_ATOM, idAtom), element, excludedSelectors, context)))
+    {
+      return selector;
+    }
+  }
+
+  // Search tag/className filters, then general class name filters
+  if (classes.isComplete)
+  {
+    for (size_t i = 0; i < classes.count; i++)
+    {
+      if ((selector = Match(elementHideTagsClass.Find(tagAtom, classes.atoms[i]), element, excludedSelectors, context)) ||
+          (selector = Match(elementHideTagsClass.Find(AtomTable::EMPTY_ATOM, classes.atoms[i]), element, excludedSelectors, context)))
+      {
+        return selector;
+      }
+    }
+  }
+  else
+  {
+    for (const wchar_t* className = classNames.c_str(); className != classNamesEnd; )
+    {
+      if (IsClassNameSeparator(*className))
+      {
+        ++className;
+        continue;
+      }
+      const wchar_t* classNameEnd = std::find_if(className, classNamesEnd, IsClassNameSeparator);
+      Atom classAtom = m_atoms.Find(className, classNameEnd - className);
+      if ((selector = Match(elementHideTagsClass.Find(tagAtom, classAtom), element, excludedSelectors, context)) ||
+          (selector = Match(elementHideTagsClass.Find(AtomTable::EMPTY_ATOM, classAtom), element, excludedSelectors, context)))
+      {
+        return selector;
+      }
+
+      // Next class name
+      className = classNameEnd;
+    }
+  }
+
+  // Search tag filters
+  return Match(elementHideTags.Find(tagAtom, AtomTable::EMPTY_ATOM), element, excludedSelectors, context);
+}
+
+// ============================================================================
+// CElementHideMatcher::ActiveRules
+// ============================================================================
+
+CElementHideMatcher::ActiveRules::ActiveRules() : m_matcher(0), m_version(0)
+{
+}
+
+size_t CElementHideMatcher::ActiveRules::GetSize() const
+{
+  return m_elementHideTagsId.GetSize() + m_elementHideTagsClass.GetSize() + m_elementHideTags.GetSize();
+}
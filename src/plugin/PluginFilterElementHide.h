@@ -0,0 +1,293 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PLUGIN_FILTER_ELEMENT_HIDE_H_
+#define _PLUGIN_FILTER_ELEMENT_HIDE_H_
+
+#include <memory>
+#include <set>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "PluginAncestorFilter.h"
+#include "PluginElementSnapshot.h"
+#include "PluginFilterIndex.h"
+
+enum CFilterElementHideAttrPos
+{
+  POS_NONE = 0, STARTING, ENDING, ANYWHERE, EXACT
+};
+
+enum CFilterElementHideAttrType
+{
+  TYPE_NONE = 0, STYLE, ID, CLASS
+};
+// ============================================================================
+// CFilterElementHideAttrSelector
+// ============================================================================
+
+class CFilterElementHideAttrSelector
+{
+
+public:
+
+  CFilterElementHideAttrPos m_pos;
+
+  CFilterElementHideAttrType m_type;
+
+  std::wstring m_attr;
+  std::wstring m_value;
+
+  CFilterElementHideAttrSelector();
+};
+
+
+
+// ============================================================================
+// CFilterElementHide
+// ============================================================================
+class CFilterElementHide
+{
+
+public:
+
+  enum ETraverserComplexType
+  {
+    TRAVERSER_TYPE_PARENT,
+    TRAVERSER_TYPE_IMMEDIATE,
+    TRAVERSER_TYPE_DESCENDANT,
+    TRAVERSER_TYPE_ERROR
+  };
+
+
+  std::wstring m_filterText;
+  // The complete selector, only set on the terminating element of a complex
+  // selector
+  std::wstring m_selector;
+
+  // For domain specific filters only
+  std::wstring m_tagId;
+  // All of these, e.g. "ad" and "wide" for div.ad.wide
+  std::vector<std::wstring> m_tagClassNames;
+  std::wstring m_tag;
+
+  std::vector<CFilterElementHideAttrSelector> m_attributeSelectors;
+  std::shared_ptr<CFilterElementHide> m_predecessor;
+
+  // Throws std::runtime_error if the selector can't be parsed
+  explicit CFilterElementHide(const std::wstring& filterText);
+  ETraverserComplexType m_type;
+
+};
+
+// ============================================================================
+// SelectorInstruction
+// ============================================================================
+
+// Selectors are compiled into a sequence of these, see
+// CElementHideMatcher::Run(). Strings are referenced by atom or by their
+// position in the matcher's string pool.
+struct SelectorInstruction
+{
+  enum Opcode
+  {
+    OP_TAG_EQ,          // value: tag atom
+    OP_ID_EQ,           // value: id atom
+    OP_HAS_CLASS,       // value: class name atom
+    OP_HAS_CLASSES,     // value and length: sorted class name atoms
+    OP_ATTR_EXISTS,     // attribute
+    OP_ATTR_EQ,         // attribute, value and length: string
+    OP_ATTR_PREFIX,
+    OP_ATTR_SUFFIX,
+    OP_ATTR_SUBSTR,
+    OP_PARENT,          // continues with the parent element
+    OP_PREVIOUS_SIBLING,// continues with the previous sibling element
+    OP_ANCESTOR,        // continues with each ancestor until the rest matches
+    OP_BLOOM_CHECK,     // value and length: ancestor hashes, see AncestorFilter
+    OP_MATCH
+  };
+
+  // Attributes other than these are looked up by name
+  enum Attribute
+  {
+    ATTRIBUTE_NAMED,
+    ATTRIBUTE_STYLE,
+    ATTRIBUTE_ID,
+    ATTRIBUTE_CLASS
+  };
+
+  uint8_t opcode;
+  uint8_t attribute;
+  // Index into the attribute names for ATTRIBUTE_NAMED
+  uint16_t name;
+  uint32_t value;
+  uint32_t length;
+};
+
+// ============================================================================
+// CElementHideMatcher
+// ============================================================================
+
+// The element hiding selectors of one filter list, indexed by tag, id and
+// class name. Doesn't depend on ATL or MSHTML.
+class CElementHideMatcher
+{
+
+public:
+
+  class ActiveRules;
+
+  CElementHideMatcher();
+
+  // Throws std::runtime_error if the selector can't be parsed. The selector
+  // only becomes visible to Match() once Build() has been called.
+  void AddSelector(const std::wstring& selector);
+  // Adds the selectors the way AddSelector() does on up to threadCount
+  // threads. Each thread compiles a contiguous part into a matcher of its
+  // own, these are merged in order afterwards. Returns the selectors that
+  // couldn't be parsed.
+  std::vector<std::wstring> AddSelectors(const std::vector<std::wstring>& selectors, size_t threadCount);
+  void Build();
+  void Clear();
+
+  // Keeps all rules, optionally except those a style sheet takes care of,
+  // see GetCssSelectors()
+  void KeepAll(ActiveRules& rules, bool includeCssSelectors = true) const;
+
+  // Appends the selectors a style sheet hides exactly the same elements for
+  void GetCssSelectors(const std::set<std::wstring>& excludedSelectors, std::vector<std::wstring>& selectors) const;
+
+  // Returns the selector hiding the element, or null. The snapshot can be
+  // passed to several matchers, properties are fetched only once. If the
+  // ancestors of the element are given, selectors requiring ancestors that
+  // aren't there are rejected without walking up the tree. Active rules from
+  // KeepAll() restrict the candidates, they are ignored once the matcher
+  // changed.
+  const std::wstring* Match(const ElementSnapshot& element, const std::set<std::wstring>& excludedSelectors,
+    const AncestorFilter* ancestors = 0, const ActiveRules* rules = 0) const;
+
+private:
+
+  struct Rule
+  {
+    // Start of the compiled selector
+    uint32_t program;
+    // Index into m_selectors
+    uint32_t selector;
+  };
+
+  // Rule requiring several class names, indexed by the rarest one in Build()
+  struct MultiClassRule
+  {
+    Atom tag;
+    // Range in m_classAtoms
+    uint32_t classes;
+    uint32_t classCount;
+    Rule rule;
+  };
+
+  // Known class names of the element passed to Match(), sorted. Elements
+  // with more class names than fit are matched using their class attribute.
+  struct ElementClasses
+  {
+    static const size_t CAPACITY = 32;
+    Atom atoms[CAPACITY];
+    size_t count;
+    bool isComplete;
+  };
+
+  struct MatchContext
+  {
+    const AncestorFilter* ancestors;
+    ElementClasses classes;
+  };
+
+  // (Tag,Name) -> Rule, tag-only rules are stored with an empty name
+  typedef FilterIndex<Rule> TRuleIndex;
+
+  uint32_t Compile(const CFilterElementHide& filter);
+  // Appends the rules of a matcher Build() hasn't been called for yet
+  void Merge(const CElementHideMatcher& other);
+  void Emit(SelectorInstruction::Opcode opcode, uint32_t value = 0);
+  void EmitAttribute(const CFilterElementHideAttrSelector& selector);
+  // The context is only given for the element passed to Match()
+  bool Run(uint32_t pc, const ElementSnapshot& element, const MatchContext* context) const;
+  bool HasClasses(const ElementSnapshot& element, const Atom* classes, size_t classCount,
+    const MatchContext* context) const;
+  const std::wstring* Match(const TRuleIndex::Range& candidates, const ElementSnapshot& element,
+    const std::set<std::wstring>& excludedSelectors, const MatchContext& context) const;
+
+  // Tag, id and class names of the element hiding filters
+  AtomTable m_atoms;
+
+  TRuleIndex m_elementHideTagsId;
+  TRuleIndex m_elementHideTagsClass;
+  TRuleIndex m_elementHideTags;
+
+  std::vector<SelectorInstruction> m_program;
+  // Attribute values, style values are already lower case
+  std::vector<wchar_t> m_strings;
+  // Operands of OP_BLOOM_CHECK
+  std::vector<uint32_t> m_ancestorHashes;
+  // Operands of OP_HAS_CLASSES
+  std::vector<Atom> m_classAtoms;
+  // Number of selectors requiring each class name, indexed by atom
+  std::vector<uint32_t> m_classFrequencies;
+  std::vector<MultiClassRule> m_pendingMultiClassRules;
+  // Changes whenever rules are added or removed, see ActiveRules
+  uint32_t m_version;
+  std::vector<std::wstring> m_attributeNames;
+  std::vector<std::wstring> m_selectors;
+  // Whether CSS can express the selector, by index into m_selectors
+  std::vector<bool> m_cssSelectors;
+
+  CElementHideMatcher(const CElementHideMatcher&);
+  CElementHideMatcher& operator=(const CElementHideMatcher&);
+};
+
+// ============================================================================
+// CElementHideMatcher::ActiveRules
+// ============================================================================
+
+// The subset of a matcher's rules a document's traversal has to check
+class CElementHideMatcher::ActiveRules
+{
+
+public:
+
+  ActiveRules();
+
+  // Number of rules kept
+  size_t GetSize() const;
+
+private:
+
+  friend class CElementHideMatcher;
+
+  const CElementHideMatcher* m_matcher;
+  uint32_t m_version;
+
+  TRuleIndex m_elementHideTagsId;
+  TRuleIndex m_elementHideTagsClass;
+  TRuleIndex m_elementHideTags;
+
+  ActiveRules(const ActiveRules&);
+  ActiveRules& operator=(const ActiveRules&);
+};
+
+#endif // _PLUGIN_FILTER_ELEMENT_HIDE_H_
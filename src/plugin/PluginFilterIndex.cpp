@@ -0,0 +1,148 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PluginFilterIndex.h"
+
+// ============================================================================
+// AtomTable
+// ============================================================================
+
+const Atom AtomTable::EMPTY_ATOM;
+const Atom AtomTable::UNKNOWN_ATOM;
+
+AtomTable::AtomTable()
+{
+}
+
+uint32_t AtomTable::Hash(const wchar_t* str, size_t length)
+{
+  // FNV-1a
+  uint32_t hash = 2166136261U;
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= static_cast<uint32_t>(str[i]);
+    hash *= 16777619U;
+  }
+  return hash;
+}
+
+bool AtomTable::Equals(Atom atom, const wchar_t* str, size_t length) const
+{
+  if (atom == EMPTY_ATOM || atom == UNKNOWN_ATOM)
+  {
+    return atom == EMPTY_ATOM && length == 0;
+  }
+  const StringRef& ref = m_strings[atom - 1];
+  return ref.length == length &&
+    std::equal(str, str + length, m_characters.begin() + ref.offset);
+}
+
+const wchar_t* AtomTable::GetString(Atom atom, size_t& length) const
+{
+  if (atom == EMPTY_ATOM || atom == UNKNOWN_ATOM)
+  {
+    length = 0;
+    return L"";
+  }
+  const StringRef& ref = m_strings[atom - 1];
+  length = ref.length;
+  return ref.length ? &m_characters[ref.offset] : L"";
+}
+
+Atom AtomTable::Intern(const wchar_t* str, size_t length)
+{
+  if (length == 0)
+  {
+    return EMPTY_ATOM;
+  }
+
+  Atom atom = Find(str, length);
+  if (atom != UNKNOWN_ATOM)
+  {
+    return atom;
+  }
+
+  if ((m_strings.size() + 1) * 2 > m_slots.size())
+  {
+    Grow();
+  }
+
+  StringRef ref;
+  ref.offset = static_cast<uint32_t>(m_characters.size());
+  ref.length = static_cast<uint32_t>(length);
+  ref.hash = Hash(str, length);
+  m_characters.insert(m_characters.end(), str, str + length);
+  m_strings.push_back(ref);
+  atom = static_cast<Atom>(m_strings.size());
+
+  size_t mask = m_slots.size() - 1;
+  size_t index = ref.hash & mask;
+  while (m_slots[index] != EMPTY_ATOM)
+  {
+    index = (index + 1) & mask;
+  }
+  m_slots[index] = atom;
+  return atom;
+}
+
+Atom AtomTable::Find(const wchar_t* str, size_t length) const
+{
+  if (length == 0)
+  {
+    return EMPTY_ATOM;
+  }
+  if (m_slots.empty())
+  {
+    return UNKNOWN_ATOM;
+  }
+
+  uint32_t hash = Hash(str, length);
+  size_t mask = m_slots.size() - 1;
+  for (size_t index = hash & mask; m_slots[index] != EMPTY_ATOM; index = (index + 1) & mask)
+  {
+    Atom atom = m_slots[index];
+    if (m_strings[atom - 1].hash == hash && Equals(atom, str, length))
+    {
+      return atom;
+    }
+  }
+  return UNKNOWN_ATOM;
+}
+
+void AtomTable::Clear()
+{
+  m_characters.clear();
+  m_strings.clear();
+  m_slots.clear();
+}
+
+void AtomTable::Grow()
+{
+  size_t capacity = m_slots.empty() ? 64 : m_slots.size() * 2;
+  std::vector<Atom> slots(capacity, EMPTY_ATOM);
+  size_t mask = capacity - 1;
+  for (size_t i = 0; i < m_strings.size(); i++)
+  {
+    size_t index = m_strings[i].hash & mask;
+    while (slots[index] != EMPTY_ATOM)
+    {
+      index = (index + 1) & mask;
+    }
+    slots[index] = static_cast<Atom>(i + 1);
+  }
+  m_slots.swap(slots);
+}
@@ -0,0 +1,288 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PLUGIN_FILTER_INDEX_H_
+#define _PLUGIN_FILTER_INDEX_H_
+
+#include <algorithm>
+#include <cstddef>
+#include <stdint.h>
+#include <utility>
+#include <vector>
+
+// Interned string identifier. The empty string is always atom 0.
+typedef uint32_t Atom;
+
+// ============================================================================
+// AtomTable
+// ============================================================================
+
+// Maps strings to small integers. The characters of all interned strings are
+// kept in one buffer and looked up through an open-addressing hash table, so
+// Find() neither allocates nor needs a terminated string.
+class AtomTable
+{
+public:
+  static const Atom EMPTY_ATOM = 0;
+  // Returned by Find() for strings that were never interned
+  static const Atom UNKNOWN_ATOM = 0xFFFFFFFF;
+
+  AtomTable();
+
+  Atom Intern(const wchar_t* str, size_t length);
+  Atom Find(const wchar_t* str, size_t length) const;
+  // Returns true if the atom stands for the given string
+  bool Equals(Atom atom, const wchar_t* str, size_t length) const;
+  // Returns the characters of the atom, they aren't terminated
+  const wchar_t* GetString(Atom atom, size_t& length) const;
+  void Clear();
+
+  // Number of interned strings, not counting the empty string
+  size_t GetSize() const
+  {
+    return m_strings.size();
+  }
+
+private:
+  struct StringRef
+  {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t hash;
+  };
+
+  static uint32_t Hash(const wchar_t* str, size_t length);
+  void Grow();
+
+  std::vector<wchar_t> m_characters;
+  std::vector<StringRef> m_strings;
+  // Power of two sized, holds atoms (EMPTY_ATOM marks a free slot)
+  std::vector<Atom> m_slots;
+};
+
+// ============================================================================
+// FilterIndex
+// ============================================================================
+
+// Multimap from (tag atom, name atom) to filters. Filters are added with
+// Add() and become visible to Find() once Build() has been called. Build()
+// stores all filters of a key next to each other in insertion order and
+// indexes the ranges with an open-addressing hash table, so a lookup is a few
+// probes yielding a contiguous array.
+template<typename T>
+class FilterIndex
+{
+public:
+  typedef const T* const_iterator;
+  typedef std::pair<const_iterator, const_iterator> Range;
+
+  FilterIndex()
+  {
+  }
+
+  void Add(Atom tag, Atom name, const T& filter)
+  {
+    m_pending.push_back(std::make_pair(MakeKey(tag, name), filter));
+  }
+
+  void Build()
+  {
+    if (m_pending.empty())
+    {
+      return;
+    }
+
+    // Merge built entries back so that Add() can be used after Build()
+    std::vector<std::pair<uint64_t, size_t> > order;
+    std::vector<const T*> sources;
+    for (typename std::vector<Slot>::const_iterator it = m_slots.begin(); it != m_slots.end(); ++it)
+    {
+      for (uint32_t i = it->begin; i < it->end; i++)
+      {
+        order.push_back(std::make_pair(it->key, sources.size()));
+        sources.push_back(&m_filters[i]);
+      }
+    }
+    for (typename std::vector<std::pair<uint64_t, T> >::const_iterator it = m_pending.begin(); it != m_pending.end(); ++it)
+    {
+      order.push_back(std::make_pair(it->first, sources.size()));
+      sources.push_back(&it->second);
+    }
+    std::stable_sort(order.begin(), order.end(), CompareKeys);
+
+    std::vector<T> filters;
+    filters.reserve(order.size());
+    size_t distinctKeys = 0;
+    for (size_t i = 0; i < order.size(); i++)
+    {
+      filters.push_back(*sources[order[i].second]);
+      if (i == 0 || order[i].first != order[i - 1].first)
+      {
+        distinctKeys++;
+      }
+    }
+
+    size_t capacity = 8;
+    while (capacity < distinctKeys * 2)
+    {
+      capacity *= 2;
+    }
+    std::vector<Slot> slots(capacity);
+    for (size_t begin = 0; begin < order.size(); )
+    {
+      size_t end = begin + 1;
+      while (end < order.size() && order[end].first == order[begin].first)
+      {
+        end++;
+      }
+      size_t index = HashKey(order[begin].first) & (capacity - 1);
+      while (slots[index].begin != slots[index].end)
+      {
+        index = (index + 1) & (capacity - 1);
+      }
+      slots[index].key = order[begin].first;
+      slots[index].begin = static_cast<uint32_t>(begin);
+      slots[index].end = static_cast<uint32_t>(end);
+      begin = end;
+    }
+
+    m_filters.swap(filters);
+    m_slots.swap(slots);
+    m_pending.clear();
+  }
+
+  Range Find(Atom tag, Atom name) const
+  {
+    if (m_slots.empty() || tag == AtomTable::UNKNOWN_ATOM || name == AtomTable::UNKNOWN_ATOM)
+    {
+      return Range(0, 0);
+    }
+    uint64_t key = MakeKey(tag, name);
+    size_t mask = m_slots.size() - 1;
+    for (size_t index = HashKey(key) & mask; ; index = (index + 1) & mask)
+    {
+      const Slot& slot = m_slots[index];
+      if (slot.begin == slot.end)
+      {
+        return Range(0, 0);
+      }
+      if (slot.key == key)
+      {
+        const T* filters = &m_filters[0];
+        return Range(filters + slot.begin, filters + slot.end);
+      }
+    }
+  }
+
+  // Adds the built filters of the other index accepted by
+  // keep(tag, name, filter). Build() has to be called afterwards.
+  template<typename Predicate>
+  void AddIf(const FilterIndex& other, Predicate keep)
+  {
+    for (typename std::vector<Slot>::const_iterator it = other.m_slots.begin(); it != other.m_slots.end(); ++it)
+    {
+      Atom tag = static_cast<Atom>(it->key >> 32);
+      Atom name = static_cast<Atom>(it->key);
+      for (uint32_t i = it->begin; i < it->end; i++)
+      {
+        if (keep(tag, name, other.m_filters[i]))
+        {
+          m_pending.push_back(std::make_pair(it->key, other.m_filters[i]));
+        }
+      }
+    }
+  }
+
+  // Adds all filters of the other index, built or not, after passing them to
+  // map(tag, name, filter) which can change them. Filters of the same key
+  // keep their order. Build() has to be called afterwards.
+  template<typename Mapping>
+  void AddMapped(const FilterIndex& other, Mapping map)
+  {
+    for (typename std::vector<Slot>::const_iterator it = other.m_slots.begin(); it != other.m_slots.end(); ++it)
+    {
+      for (uint32_t i = it->begin; i < it->end; i++)
+      {
+        AddMapped(it->key, other.m_filters[i], map);
+      }
+    }
+    for (typename std::vector<std::pair<uint64_t, T> >::const_iterator it = other.m_pending.begin();
+         it != other.m_pending.end(); ++it)
+    {
+      AddMapped(it->first, it->second, map);
+    }
+  }
+
+  void Clear()
+  {
+    m_filters.clear();
+    m_slots.clear();
+    m_pending.clear();
+  }
+
+  // Number of built filters
+  size_t GetSize() const
+  {
+    return m_filters.size();
+  }
+
+private:
+  struct Slot
+  {
+    Slot() : key(0), begin(0), end(0)
+    {
+    }
+    uint64_t key;
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  static uint64_t MakeKey(Atom tag, Atom name)
+  {
+    return (static_cast<uint64_t>(tag) << 32) | name;
+  }
+
+  static size_t HashKey(uint64_t key)
+  {
+    key *= 0x9E3779B97F4A7C15ULL;
+    return static_cast<size_t>(key >> 32);
+  }
+
+  static bool CompareKeys(const std::pair<uint64_t, size_t>& a, const std::pair<uint64_t, size_t>& b)
+  {
+    return a.first < b.first;
+  }
+
+  template<typename Mapping>
+  void AddMapped(uint64_t key, const T& filter, Mapping& map)
+  {
+    Atom tag = static_cast<Atom>(key >> 32);
+    Atom name = static_cast<Atom>(key);
+    T mapped(filter);
+    map(tag, name, mapped);
+    Add(tag, name, mapped);
+  }
+
+  std::vector<T> m_filters;
+  std::vector<Slot> m_slots;
+  std::vector<std::pair<uint64_t, T> > m_pending;
+
+  FilterIndex(const FilterIndex&);
+  FilterIndex& operator=(const FilterIndex&);
+};
+
+#endif // _PLUGIN_FILTER_INDEX_H_
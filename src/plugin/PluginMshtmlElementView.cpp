@@ -0,0 +1,164 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PluginStdAfx.h"
+
+#include "PluginMshtmlElementView.h"
+
+namespace
+{
+  std::wstring BstrToWstring(const ATL::CComBSTR& bstr)
+  {
+    return bstr ? std::wstring(bstr, bstr.Length()) : std::wstring();
+  }
+
+  struct GetHtmlElementAttributeResult
+  {
+    GetHtmlElementAttributeResult() : isAttributeFound(false)
+    {
+    }
+    std::wstring attributeValue;
+    bool isAttributeFound;
+  };
+
+  GetHtmlElementAttributeResult GetHtmlElementAttribute(IHTMLElement& htmlElement,
+    const ATL::CComBSTR& attributeName)
+  {
+    GetHtmlElementAttributeResult retValue;
+    ATL::CComVariant vAttr;
+    ATL::CComPtr<IHTMLElement4> htmlElement4;
+    if (FAILED(htmlElement.QueryInterface(&htmlElement4)) || !htmlElement4)
+    {
+      return retValue;
+    }
+    ATL::CComPtr<IHTMLDOMAttribute> attributeNode;
+    if (FAILED(htmlElement4->getAttributeNode(attributeName, &attributeNode)) || !attributeNode)
+    {
+      return retValue;
+    }
+    // we set that attribute found but it's not necessary that we can retrieve its value
+    retValue.isAttributeFound = true;
+    if (FAILED(attributeNode->get_nodeValue(&vAttr)))
+    {
+      return retValue;
+    }
+    if (vAttr.vt == VT_BSTR && vAttr.bstrVal)
+    {
+      retValue.attributeValue = vAttr.bstrVal;
+    }
+    else if (vAttr.vt == VT_I4)
+    {
+      retValue.attributeValue = std::to_wstring(vAttr.iVal);
+    }
+    return retValue;
+  }
+}
+
+// ============================================================================
+// MshtmlElementView
+// ============================================================================
+
+MshtmlElementView::MshtmlElementView(IHTMLElement* element) : m_element(element)
+{
+}
+
+std::wstring MshtmlElementView::GetTagName() const
+{
+  ATL::CComBSTR tagName;
+  if (FAILED(m_element->get_tagName(&tagName)) || !tagName)
+  {
+    return std::wstring();
+  }
+  tagName.ToLower();
+  return BstrToWstring(tagName);
+}
+
+std::wstring MshtmlElementView::GetId() const
+{
+  ATL::CComBSTR id;
+  if (FAILED(m_element->get_id(&id)))
+  {
+    return std::wstring();
+  }
+  return BstrToWstring(id);
+}
+
+std::wstring MshtmlElementView::GetClassName() const
+{
+  ATL::CComBSTR className;
+  if (FAILED(m_element->get_className(&className)))
+  {
+    return std::wstring();
+  }
+  return BstrToWstring(className);
+}
+
+bool MshtmlElementView::GetStyle(std::wstring& cssText) const
+{
+  ATL::CComPtr<IHTMLStyle> style;
+  ATL::CComBSTR bstrCssText;
+  if (FAILED(m_element->get_style(&style)) || !style ||
+      FAILED(style->get_cssText(&bstrCssText)) || !bstrCssText)
+  {
+    return false;
+  }
+  cssText = BstrToWstring(bstrCssText);
+  return true;
+}
+
+bool MshtmlElementView::GetAttribute(const std::wstring& name, std::wstring& value) const
+{
+  GetHtmlElementAttributeResult attribute = GetHtmlElementAttribute(*m_element, ATL::CComBSTR(name.c_str()));
+  if (attribute.isAttributeFound)
+  {
+    value = attribute.attributeValue;
+  }
+  return attribute.isAttributeFound;
+}
+
+std::unique_ptr<ElementView> MshtmlElementView::GetParent() const
+{
+  ATL::CComPtr<IHTMLElement> parent;
+  if (m_element->get_parentElement(&parent) != S_OK || !parent)
+  {
+    return std::unique_ptr<ElementView>();
+  }
+  return std::unique_ptr<ElementView>(new MshtmlElementView(parent));
+}
+
+std::unique_ptr<ElementView> MshtmlElementView::GetPreviousSibling() const
+{
+  ATL::CComQIPtr<IHTMLDOMNode> pPrevSiblingNode = m_element;
+  long type = 0;
+  while (pPrevSiblingNode && type != 1)
+  {
+    IHTMLDOMNode* tmpNode = 0;
+    pPrevSiblingNode->get_previousSibling(&tmpNode);
+    pPrevSiblingNode.Attach(tmpNode);
+    if (pPrevSiblingNode && pPrevSiblingNode->get_nodeType(&type) != S_OK)
+    {
+      pPrevSiblingNode.Release();
+    }
+  }
+
+  ATL::CComPtr<IHTMLElement> sibling;
+  if (!pPrevSiblingNode || pPrevSiblingNode.QueryInterface(&sibling) != S_OK || !sibling)
+  {
+    return std::unique_ptr<ElementView>();
+  }
+  return std::unique_ptr<ElementView>(new MshtmlElementView(sibling));
+}
@@ -0,0 +1,45 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PLUGIN_MSHTML_ELEMENT_VIEW_H_
+#define _PLUGIN_MSHTML_ELEMENT_VIEW_H_
+
+#include "PluginElementView.h"
+
+// ============================================================================
+// MshtmlElementView
+// ============================================================================
+
+class MshtmlElementView : public ElementView
+{
+public:
+  explicit MshtmlElementView(IHTMLElement* element);
+
+  std::wstring GetTagName() const;
+  std::wstring GetId() const;
+  std::wstring GetClassName() const;
+  bool GetStyle(std::wstring& cssText) const;
+  bool GetAttribute(const std::wstring& name, std::wstring& value) const;
+
+  std::unique_ptr<ElementView> GetParent() const;
+  std::unique_ptr<ElementView> GetPreviousSibling() const;
+
+private:
+  ATL::CComPtr<IHTMLElement> m_element;
+};
+
+#endif // _PLUGIN_MSHTML_ELEMENT_VIEW_H_
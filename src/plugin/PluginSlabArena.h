@@ -0,0 +1,119 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PLUGIN_SLAB_ARENA_H_
+#define _PLUGIN_SLAB_ARENA_H_
+
+#include <stddef.h>
+#include <vector>
+
+// ============================================================================
+// SlabArena
+// ============================================================================
+
+// Growable array of default constructed elements, allocated in slabs of
+// SLAB_SIZE elements. Growing never moves elements, references stay valid
+// until Clear(). Clear() puts the slabs on a free list for the next page,
+// keeping at most maxFreeSlabs of them, so that a single heavy page doesn't
+// pin its peak memory for the lifetime of the tab.
+template <class T, size_t SLAB_SIZE = 1024>
+class SlabArena
+{
+public:
+  explicit SlabArena(size_t maxFreeSlabs = 4)
+    : m_size(0), m_maxFreeSlabs(maxFreeSlabs)
+  {
+  }
+
+  ~SlabArena()
+  {
+    Clear();
+    ReleaseSlabs(0);
+  }
+
+  // Appends a default constructed element and returns its index
+  size_t Add()
+  {
+    if (m_size == m_slabs.size() * SLAB_SIZE)
+    {
+      if (m_freeSlabs.empty())
+      {
+        m_slabs.push_back(new T[SLAB_SIZE]);
+      }
+      else
+      {
+        m_slabs.push_back(m_freeSlabs.back());
+        m_freeSlabs.pop_back();
+      }
+    }
+    return m_size++;
+  }
+
+  T& operator[](size_t index)
+  {
+    return m_slabs[index / SLAB_SIZE][index % SLAB_SIZE];
+  }
+
+  const T& operator[](size_t index) const
+  {
+    return m_slabs[index / SLAB_SIZE][index % SLAB_SIZE];
+  }
+
+  size_t GetSize() const
+  {
+    return m_size;
+  }
+
+  // Resets the elements, slabs on the free list are default constructed
+  void Clear()
+  {
+    for (size_t i = 0; i < m_size; i++)
+    {
+      (*this)[i] = T();
+    }
+    m_freeSlabs.insert(m_freeSlabs.end(), m_slabs.begin(), m_slabs.end());
+    m_slabs.clear();
+    m_size = 0;
+    ReleaseSlabs(m_maxFreeSlabs);
+  }
+
+  // Bytes held by the used and the free slabs
+  size_t GetResidentSize() const
+  {
+    return (m_slabs.size() + m_freeSlabs.size()) * SLAB_SIZE * sizeof(T);
+  }
+
+private:
+  void ReleaseSlabs(size_t keep)
+  {
+    while (m_freeSlabs.size() > keep)
+    {
+      delete [] m_freeSlabs.back();
+      m_freeSlabs.pop_back();
+    }
+  }
+
+  std::vector<T*> m_slabs;
+  std::vector<T*> m_freeSlabs;
+  size_t m_size;
+  size_t m_maxFreeSlabs;
+
+  SlabArena(const SlabArena&);
+  SlabArena& operator=(const SlabArena&);
+};
+
+#endif // _PLUGIN_SLAB_ARENA_H_
@@ -0,0 +1,53 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PluginStyleSheet.h"
+
+#include <algorithm>
+
+namespace
+{
+  const wchar_t hidingDeclaration[] = L" { display: none !important; }\n";
+}
+
+std::vector<std::wstring> BuildHidingStyleSheets(const std::vector<std::wstring>& selectors, size_t maxRules)
+{
+  std::vector<std::wstring> styleSheets;
+  if (maxRules == 0)
+  {
+    return styleSheets;
+  }
+  for (size_t begin = 0; begin < selectors.size(); begin += maxRules)
+  {
+    size_t end = std::min(begin + maxRules, selectors.size());
+    size_t length = 0;
+    for (size_t i = begin; i < end; i++)
+    {
+      length += selectors[i].size() + (sizeof(hidingDeclaration) / sizeof(hidingDeclaration[0]) - 1);
+    }
+
+    std::wstring styleSheet;
+    styleSheet.reserve(length);
+    for (size_t i = begin; i < end; i++)
+    {
+      styleSheet += selectors[i];
+      styleSheet += hidingDeclaration;
+    }
+    styleSheets.push_back(styleSheet);
+  }
+  return styleSheets;
+}
@@ -0,0 +1,34 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PLUGIN_STYLE_SHEET_H_
+#define _PLUGIN_STYLE_SHEET_H_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Internet Explorer 9 and below ignore the rules of a style sheet beyond this
+const size_t MAX_STYLE_SHEET_RULES = 4095;
+
+// Builds style sheets hiding the elements matched by the selectors, with at
+// most maxRules rules each. Every selector gets a rule of its own, so that a
+// selector IE doesn't understand only invalidates that rule.
+std::vector<std::wstring> BuildHidingStyleSheets(const std::vector<std::wstring>& selectors,
+  size_t maxRules = MAX_STYLE_SHEET_RULES);
+
+#endif // _PLUGIN_STYLE_SHEET_H_
@@ -37,6 +37,7 @@ CPluginTabBase::CPluginTabBase(CPluginClass* plugin)
   : m_plugin(plugin)
   , m_isActivated(false)
   , m_continueThreadRunning(true)
+  , m_elementHidingPrefs()
 {
   m_filter = std::auto_ptr<CPluginFilter>(new CPluginFilter());
   m_filter->hideFiltersLoadedEvent = CreateEvent(NULL, true, false, NULL);
@@ -84,9 +85,34 @@ void CPluginTabBase::OnUpdate()
 
 namespace
 {
+  // Attempts to get a matching pair of domain and generic selectors before
+  // the filter loader gives up on the generic ones
+  const int MAX_GENERIC_FILTER_ATTEMPTS = 3;
+
   void FilterLoader(CPluginTabBase* tabBase)
   {
-    tabBase->m_filter->LoadHideFilters(CPluginClient::GetInstance()->GetElementHidingSelectors(tabBase->GetDocumentDomain()));
+    // Only the domain specific part is fetched and parsed for each
+    // navigation, the generic selectors are shared by all tabs.
+    CPluginClient* client = CPluginClient::GetInstance();
+    std::vector<std::wstring> selectors;
+    std::vector<std::wstring> excludedSelectors;
+    std::shared_ptr<const CPluginFilter> genericFilter;
+    for (int attempt = 0; attempt < MAX_GENERIC_FILTER_ATTEMPTS && !genericFilter; attempt++)
+    {
+      // Both parts have to be of the same generation, otherwise the
+      // exclusions don't fit the generic selectors. A filter change in
+      // between makes GetGenericFilter() fail and the delta is fetched again.
+      int32_t generation;
+      if (!client->GetElementHidingSelectorsDelta(tabBase->GetDocumentDomain(), generation, selectors, excludedSelectors))
+      {
+        selectors.clear();
+        break;
+      }
+      genericFilter = client->GetGenericFilter(generation);
+    }
+    tabBase->m_filter->LoadHideFilters(selectors, genericFilter, excludedSelectors);
+    tabBase->m_elementHidingPrefs.isStyleSheetHiding = client->GetPref(L"elemhide_stylesheets", false);
+    tabBase->m_elementHidingPrefs.isIncremental = client->GetPref(L"elemhide_incremental", false);
     SetEvent(tabBase->m_filter->hideFiltersLoadedEvent);
   }
 }
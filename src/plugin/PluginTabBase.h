@@ -55,6 +55,15 @@ protected:
   static int s_filterVersion;
 public:
   std::auto_ptr<CPluginFilter> m_filter;
+
+  // Read by the filter loader once per navigation, so that the traversal
+  // doesn't ask the engine. Valid once hideFiltersLoadedEvent is set.
+  struct ElementHidingPrefs
+  {
+    bool isStyleSheetHiding;
+    bool isIncremental;
+  };
+  ElementHidingPrefs m_elementHidingPrefs;
 private:
   static int s_whitelistVersion;
 
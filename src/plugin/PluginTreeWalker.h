@@ -0,0 +1,139 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef _PLUGIN_TREE_WALKER_H_
+#define _PLUGIN_TREE_WALKER_H_
+
+#include <stddef.h>
+#include <vector>
+
+// ============================================================================
+// TreeWalker
+// ============================================================================
+
+// Depth first walk with an explicit stack instead of recursion. The walk can
+// be suspended between any two steps and deep nesting can't overflow the call
+// stack. The stack keeps its capacity, a walker that is reused stops
+// allocating once it has seen the deepest tree.
+//
+// Tree supplies the types and the operations on them, it is passed to every
+// call that may call back:
+//
+//   typedef ... Node;      // handle of a node
+//   typedef ... Children;  // handle of a node's children
+//   typedef ... State;     // whatever the tree keeps per open node
+//   // Called for every node, returns false if the walk shouldn't descend
+//   // into its children. depth is 0 for the root.
+//   bool Enter(const Node& node, const State& parent, size_t depth,
+//     Children& children, size_t& childCount, State& state);
+//   // Called once all children of a node that was descended into are done
+//   void Leave(const Node& node, const State& state);
+//   // Returns false if the child can't be fetched, it is skipped then
+//   bool GetChild(const Children& children, size_t index, Node& child);
+template <class Tree>
+class TreeWalker
+{
+public:
+  typedef typename Tree::Node Node;
+  typedef typename Tree::Children Children;
+  typedef typename Tree::State State;
+
+  // Enters the root, the walk in progress is abandoned without leaving its
+  // open nodes
+  void Start(Tree& tree, const Node& root, const State& parent)
+  {
+    Clear();
+    Visit(tree, root, parent);
+  }
+
+  // Enters the next node or leaves the innermost open one, returns false
+  // once the walk is done
+  bool Step(Tree& tree)
+  {
+    if (m_frames.empty())
+    {
+      return false;
+    }
+
+    Frame& frame = m_frames.back();
+    if (frame.nextChild >= frame.childCount)
+    {
+      tree.Leave(frame.node, frame.state);
+      m_frames.pop_back();
+      return !m_frames.empty();
+    }
+
+    Node child;
+    if (tree.GetChild(frame.children, frame.nextChild++, child))
+    {
+      // Visiting may grow the stack and invalidate frame
+      State parent = frame.state;
+      Visit(tree, child, parent);
+    }
+    return true;
+  }
+
+  void Clear()
+  {
+    m_frames.clear();
+  }
+
+  bool IsDone() const
+  {
+    return m_frames.empty();
+  }
+
+  // Number of open nodes, the root being the first one
+  size_t GetDepth() const
+  {
+    return m_frames.size();
+  }
+
+  const State& GetState(size_t depth) const
+  {
+    return m_frames[depth].state;
+  }
+
+private:
+  struct Frame
+  {
+    Node node;
+    Children children;
+    size_t childCount;
+    size_t nextChild;
+    State state;
+  };
+
+  void Visit(Tree& tree, const Node& node, const State& parent)
+  {
+    // Only allocates if the tree is deeper than any walked before
+    m_frames.resize(m_frames.size() + 1);
+    Frame& frame = m_frames.back();
+    frame.node = node;
+    frame.childCount = 0;
+    frame.nextChild = 0;
+    if (!tree.Enter(node, parent, m_frames.size() - 1, frame.children, frame.childCount, frame.state) ||
+        frame.childCount == 0)
+    {
+      m_frames.pop_back();
+    }
+  }
+
+  std::vector<Frame> m_frames;
+};
+
+#endif // _PLUGIN_TREE_WALKER_H_
@@ -0,0 +1,89 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+// Blocking queue for any number of producers and consumers. Push() blocks
+// while the queue is full, which gives producers backpressure.
+template<class T>
+class BoundedQueue
+{
+public:
+  explicit BoundedQueue(size_t capacity) : capacity(capacity), closed(false) {}
+
+  // Returns false if the queue has been closed, the item is dropped then
+  bool Push(T&& item)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (items.size() >= capacity && !closed)
+      notFull.wait(lock);
+    if (closed)
+      return false;
+
+    items.push_back(std::move(item));
+    notEmpty.notify_one();
+    return true;
+  }
+
+  // Blocks until an item is available. Returns false once the queue has been
+  // closed and all remaining items were taken.
+  bool Pop(T& item)
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (items.empty() && !closed)
+      notEmpty.wait(lock);
+    if (items.empty())
+      return false;
+
+    item = std::move(items.front());
+    items.pop_front();
+    notFull.notify_one();
+    return true;
+  }
+
+  void Close()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    closed = true;
+    notEmpty.notify_all();
+    notFull.notify_all();
+  }
+
+  size_t Size()
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    return items.size();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable notEmpty;
+  std::condition_variable notFull;
+  std::deque<T> items;
+  size_t capacity;
+  bool closed;
+
+  BoundedQueue(const BoundedQueue&);
+  BoundedQueue& operator=(const BoundedQueue&);
+};
+
+#endif
@@ -0,0 +1,157 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "Channel.h"
+
+namespace Communication
+{
+  struct PendingCall
+  {
+    InputBuffer* response;
+    bool done;
+    std::condition_variable condition;
+
+    explicit PendingCall(InputBuffer* response) : response(response), done(false) {}
+  };
+
+  struct ChannelState
+  {
+    std::unique_ptr<Pipe> pipe;
+    std::mutex writeMutex;
+    std::mutex mutex;
+    std::map<RequestId, PendingCall*> pendingCalls;
+    RequestId nextId;
+    bool connected;
+    bool closed;
+
+    ChannelState(std::unique_ptr<Pipe> pipe)
+      : pipe(std::move(pipe)), nextId(1), connected(true), closed(false)
+    {
+    }
+  };
+}
+
+namespace
+{
+  void Disconnect(Communication::ChannelState& state)
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.connected = false;
+    for (auto it = state.pendingCalls.begin(); it != state.pendingCalls.end(); ++it)
+      it->second->condition.notify_one();
+  }
+
+  void ReadResponses(std::shared_ptr<Communication::ChannelState> state)
+  {
+    Communication::InputBuffer message;
+    try
+    {
+      for (;;)
+      {
+        state->pipe->ReadMessage(message);
+        Communication::RequestId id = message.GetRequestId();
+
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->closed)
+          break;
+
+        auto it = state->pendingCalls.find(id);
+        if (it == state->pendingCalls.end())
+          continue;
+
+        // The waiting thread takes over the message data, no copying
+        *it->second->response = std::move(message);
+        it->second->done = true;
+        it->second->condition.notify_one();
+        state->pendingCalls.erase(it);
+      }
+    }
+    catch (const std::exception&)
+    {
+    }
+    Disconnect(*state);
+  }
+}
+
+Communication::Channel::Channel(std::unique_ptr<Communication::Pipe> pipe)
+  : state(std::make_shared<ChannelState>(std::move(pipe)))
+{
+  std::shared_ptr<ChannelState> readerState = state;
+  reader = std::thread([readerState]()
+  {
+    ReadResponses(readerState);
+  });
+}
+
+Communication::Channel::~Channel()
+{
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->closed = true;
+  }
+  // Wakes up the reader thread if it is blocked in ReadMessage()
+  state->pipe->Close();
+  reader.join();
+}
+
+void Communication::Channel::Call(Communication::OutputBuffer& request, Communication::InputBuffer& response)
+{
+  PendingCall call(&response);
+  RequestId id;
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    if (!state->connected)
+      throw PipeDisconnectedError();
+
+    id = state->nextId++;
+    state->pendingCalls[id] = &call;
+  }
+
+  try
+  {
+    request.SetRequestId(id);
+    std::lock_guard<std::mutex> lock(state->writeMutex);
+    state->pipe->WriteMessage(request);
+  }
+  catch (...)
+  {
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->pendingCalls.erase(id);
+    throw;
+  }
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  while (!call.done && state->connected)
+    call.condition.wait(lock);
+
+  if (!call.done)
+  {
+    state->pendingCalls.erase(id);
+    throw PipeDisconnectedError();
+  }
+}
+
+bool Communication::Channel::IsConnected() const
+{
+  std::lock_guard<std::mutex> lock(state->mutex);
+  return state->connected;
+}
@@ -0,0 +1,57 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include <memory>
+#include <thread>
+
+#include "Communication.h"
+
+namespace Communication
+{
+  struct ChannelState;
+
+  // Client end of a pipe that allows any number of threads to have requests
+  // in flight at the same time. Each request is tagged with a new request ID
+  // and a reader thread hands the responses, which may arrive in any order,
+  // to the threads waiting for them.
+  class Channel
+  {
+  public:
+    explicit Channel(std::unique_ptr<Pipe> pipe);
+    ~Channel();
+
+    // Sends the request and blocks until its response arrives. Throws
+    // PipeDisconnectedError if the connection is or gets closed.
+    void Call(OutputBuffer& request, InputBuffer& response);
+    bool IsConnected() const;
+
+  private:
+    // Shared with the reader thread. The destructor closes the pipe and waits
+    // for the reader thread, no thread is left running code of this module.
+    std::shared_ptr<ChannelState> state;
+    std::thread reader;
+
+    // Disallow copying
+    Channel(const Channel&);
+    Channel& operator=(const Channel&);
+  };
+}
+
+#endif
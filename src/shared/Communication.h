@@ -21,10 +21,13 @@
 #include <memory>
 #include <sstream>
 #include <stdexcept>
+#include <string.h>
 #include <stdint.h>
 #include <string>
 #include <vector>
+#ifdef _WIN32
 #include <Windows.h>
+#endif
 
 namespace Communication
 {
@@ -52,44 +55,91 @@ namespace Communication
     PROC_GET_DOCUMENTATION_LINK,
     PROC_TOGGLE_PLUGIN_ENABLED,
     PROC_GET_HOST,
-    PROC_COMPARE_VERSIONS
+    PROC_COMPARE_VERSIONS,
+    PROC_MATCHES_BATCH,
+    PROC_GET_GENERIC_ELEMHIDE_SELECTORS,
+    PROC_GET_ELEMHIDE_SELECTORS_DELTA
   };
   enum ValueType : uint32_t {
     TYPE_PROC, TYPE_STRING, TYPE_WSTRING, TYPE_INT64, TYPE_INT32, TYPE_BOOL
   };
   typedef uint32_t SizeType;
+  // Every message starts with the ID of the request it belongs to, responses
+  // carry the ID of the request they answer.
+  typedef uint32_t RequestId;
+
+  // Non-owning view of a string stored in an InputBuffer, it is only valid as
+  // long as the buffer is neither modified nor destroyed.
+  struct StringRef
+  {
+    const char* data;
+    SizeType length;
+
+    StringRef() : data(0), length(0) {}
+    std::string str() const { return std::string(data, length); }
+  };
+
+  class OutputBuffer;
 
   class InputBuffer
   {
+    friend class Transport;
   public:
-    InputBuffer() : buffer(), hasType(false) {}
-    InputBuffer(const std::string& data) : buffer(data), hasType(false) {}
-    InputBuffer(const InputBuffer& copy) 
-    { 
-      hasType = copy.hasType; 
-      buffer = std::istringstream(copy.buffer.str()); 
-      currentType = copy.currentType; 
+    InputBuffer() : position(sizeof(RequestId)), hasType(false) {}
+    // Expects a complete message, including the request ID
+    InputBuffer(const std::string& data) : buffer(data.begin(), data.end()), position(sizeof(RequestId)), hasType(false) {}
+    // Takes over the data of an output buffer without copying it
+    explicit InputBuffer(OutputBuffer&& message);
+    InputBuffer(InputBuffer&& other)
+      : buffer(std::move(other.buffer)), position(other.position),
+        currentType(other.currentType), hasType(other.hasType)
+    {
+      other.Clear();
+    }
+    InputBuffer& operator=(InputBuffer&& other)
+    {
+      buffer = std::move(other.buffer);
+      position = other.position;
+      currentType = other.currentType;
+      hasType = other.hasType;
+      other.Clear();
+      return *this;
     }
     InputBuffer& operator>>(ProcType& value) { return Read(value, TYPE_PROC); }
     InputBuffer& operator>>(std::string& value) { return ReadString(value, TYPE_STRING); }
     InputBuffer& operator>>(std::wstring& value) { return ReadString(value, TYPE_WSTRING); }
+    InputBuffer& operator>>(StringRef& value);
     InputBuffer& operator>>(int64_t& value) { return Read(value, TYPE_INT64); }
     InputBuffer& operator>>(int32_t& value) { return Read(value, TYPE_INT32); }
     InputBuffer& operator>>(bool& value) { return Read(value, TYPE_BOOL); }
-    InputBuffer& operator=(const InputBuffer& copy) 
-    { 
-      hasType = copy.hasType; 
-      buffer = std::istringstream(copy.buffer.str()); 
-      currentType = copy.currentType; 
-      return *this; 
-    }
     ValueType GetType();
+    RequestId GetRequestId() const;
+    // Number of bytes not read yet
+    size_t GetRemainingSize() const
+    {
+      return position < buffer.size() ? buffer.size() - position : 0;
+    }
+
+    // Empties the buffer but keeps the memory allocated, so that it can be
+    // reused for the next message.
+    void Clear()
+    {
+      buffer.clear();
+      position = sizeof(RequestId);
+      hasType = false;
+    }
   private:
-    std::istringstream buffer;
+    std::vector<char> buffer;
+    size_t position;
     ValueType currentType;
     bool hasType;
 
+    // Disallow copying
+    InputBuffer(const InputBuffer&);
+    InputBuffer& operator=(const InputBuffer&);
+
     void CheckType(ValueType expectedType);
+    const char* Consume(size_t length);
 
     template<class T>
     InputBuffer& ReadString(T& value, ValueType expectedType)
@@ -99,12 +149,10 @@ namespace Communication
       SizeType length;
       ReadBinary(length);
 
-      std::auto_ptr<T::value_type> data(new T::value_type[length]);
-      buffer.read(reinterpret_cast<char*>(data.get()), sizeof(T::value_type) * length);
-      if (buffer.fail())
-        throw new std::runtime_error("Unexpected end of input buffer");
-
-      value.assign(data.get(), length);
+      const char* data = Consume(sizeof(typename T::value_type) * length);
+      value.resize(length);
+      if (length)
+        memcpy(&value[0], data, sizeof(typename T::value_type) * length);
       return *this;
     }
 
@@ -119,36 +167,67 @@ namespace Communication
     template<class T>
     void ReadBinary(T& value)
     {
-      buffer.read(reinterpret_cast<char*>(&value), sizeof(T));
-      if (buffer.fail())
-        throw new std::runtime_error("Unexpected end of input buffer");
+      memcpy(&value, Consume(sizeof(T)), sizeof(T));
       hasType = false;
     }
   };
 
   class OutputBuffer
   {
+    friend class InputBuffer;
+    friend class Transport;
   public:
-    OutputBuffer() {}
-
-    // Explicit copy constructor to allow returning OutputBuffer by value
-    OutputBuffer(const OutputBuffer& copy) : buffer(copy.buffer.str()) {}
-
-    std::string Get()
+    OutputBuffer() : buffer(sizeof(RequestId)) {}
+    OutputBuffer(OutputBuffer&& other) : buffer(std::move(other.buffer))
+    {
+      other.Clear();
+    }
+    OutputBuffer& operator=(OutputBuffer&& other)
     {
-      return buffer.str();
+      buffer = std::move(other.buffer);
+      other.Clear();
+      return *this;
     }
+
     OutputBuffer& operator<<(ProcType value) { return Write(value, TYPE_PROC); }
     OutputBuffer& operator<<(const std::string& value) { return WriteString(value, TYPE_STRING); }
     OutputBuffer& operator<<(const std::wstring& value) { return WriteString(value, TYPE_WSTRING); }
     OutputBuffer& operator<<(int64_t value) { return Write(value, TYPE_INT64); }
     OutputBuffer& operator<<(int32_t value) { return Write(value, TYPE_INT32); }
     OutputBuffer& operator<<(bool value) { return Write(value, TYPE_BOOL); }
+
+    // Appends all values written to another buffer, so that encoded values
+    // can be cached and sent again without encoding them again.
+    OutputBuffer& Append(const OutputBuffer& values)
+    {
+      buffer.insert(buffer.end(), values.buffer.begin() + sizeof(RequestId), values.buffer.end());
+      return *this;
+    }
+
+    RequestId GetRequestId() const
+    {
+      RequestId id;
+      memcpy(&id, buffer.data(), sizeof(id));
+      return id;
+    }
+
+    void SetRequestId(RequestId id)
+    {
+      memcpy(buffer.data(), &id, sizeof(id));
+    }
+
+    // Empties the buffer but keeps the memory allocated, so that one buffer
+    // can serve all messages of a connection. The request ID is reset to 0.
+    void Clear()
+    {
+      buffer.assign(sizeof(RequestId), 0);
+    }
   private:
-    std::ostringstream buffer;
+    std::vector<char> buffer;
 
     // Disallow copying
-    const OutputBuffer& operator=(const OutputBuffer&);
+    OutputBuffer(const OutputBuffer&);
+    OutputBuffer& operator=(const OutputBuffer&);
 
     template<class T>
     OutputBuffer& WriteString(const T& value, ValueType type)
@@ -158,10 +237,8 @@ namespace Communication
       SizeType length = static_cast<SizeType>(value.size());
       WriteBinary(length);
 
-      buffer.write(reinterpret_cast<const char*>(value.c_str()), sizeof(T::value_type) * length);
-      if (buffer.fail())
-        throw new std::runtime_error("Unexpected error writing to output buffer");
-
+      const char* data = reinterpret_cast<const char*>(value.c_str());
+      buffer.insert(buffer.end(), data, data + sizeof(typename T::value_type) * length);
       return *this;
     }
 
@@ -176,9 +253,8 @@ namespace Communication
     template<class T>
     void WriteBinary(const T& value)
     {
-      buffer.write(reinterpret_cast<const char*>(&value), sizeof(T));
-      if (buffer.fail())
-        throw new std::runtime_error("Unexpected error writing to output buffer");
+      const char* data = reinterpret_cast<const char*>(&value);
+      buffer.insert(buffer.end(), data, data + sizeof(T));
     }
   };
 
@@ -200,19 +276,50 @@ namespace Communication
     PipeDisconnectedError();
   };
 
+  // A bidirectional connection that preserves message boundaries, every
+  // ReadMessage() call returns exactly one message written on the other end.
+  // One thread may read while another one writes, but there must never be
+  // more than one reader or more than one writer at a time.
+  class Transport
+  {
+  public:
+    virtual ~Transport() {}
+    virtual void ReadMessage(InputBuffer& message) = 0;
+    virtual void WriteMessage(OutputBuffer& message) = 0;
+    // Makes pending and future reads and writes throw PipeDisconnectedError,
+    // can be called from any thread.
+    virtual void Close() = 0;
+
+  protected:
+    static std::vector<char>& GetData(InputBuffer& message) { return message.buffer; }
+    static std::vector<char>& GetData(OutputBuffer& message) { return message.buffer; }
+  };
+
   class Pipe
   {
   public:
     enum Mode {MODE_CREATE, MODE_CONNECT};
 
-    Pipe(const std::wstring& name, Mode mode);
-    ~Pipe();
+    // The default backend is a named pipe on Windows and a Unix domain
+    // socket elsewhere. The loopback backend only connects within the
+    // current process.
+    enum Backend {BACKEND_DEFAULT, BACKEND_NAMED_PIPE, BACKEND_UNIX_SOCKET, BACKEND_LOOPBACK};
+
+    Pipe(const std::wstring& name, Mode mode, Backend backend = BACKEND_DEFAULT);
 
     InputBuffer ReadMessage();
+    // Reads the next message into an existing buffer, reusing its memory
+    void ReadMessage(InputBuffer& message);
     void WriteMessage(OutputBuffer& message);
+    // Unblocks a thread waiting in ReadMessage(), see Transport::Close()
+    void Close();
 
-  protected:
-    HANDLE pipe;
+  private:
+    std::unique_ptr<Transport> transport;
+
+    // Disallow copying
+    Pipe(const Pipe&);
+    Pipe& operator=(const Pipe&);
   };
 }
 
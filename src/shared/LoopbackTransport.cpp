@@ -0,0 +1,126 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+
+#include "LoopbackTransport.h"
+
+namespace Communication
+{
+  struct LoopbackChannel
+  {
+    std::mutex mutex;
+    std::condition_variable condition;
+    // Messages pending for side 0 (the creating end) and side 1
+    std::deque<std::vector<char> > queues[2];
+    bool closed[2];
+    bool connected;
+
+    LoopbackChannel() : connected(false)
+    {
+      closed[0] = closed[1] = false;
+    }
+  };
+}
+
+namespace
+{
+  typedef std::shared_ptr<Communication::LoopbackChannel> LoopbackChannelPtr;
+
+  // Channels created with MODE_CREATE that are still waiting for a client
+  std::mutex listenersMutex;
+  std::map<std::wstring, std::deque<LoopbackChannelPtr> > listeners;
+}
+
+Communication::LoopbackTransport::LoopbackTransport(const std::wstring& name, Communication::Pipe::Mode mode)
+{
+  if (mode == Pipe::MODE_CREATE)
+  {
+    channel = std::make_shared<LoopbackChannel>();
+    side = 0;
+    {
+      std::lock_guard<std::mutex> lock(listenersMutex);
+      listeners[name].push_back(channel);
+    }
+
+    std::unique_lock<std::mutex> lock(channel->mutex);
+    while (!channel->connected)
+      channel->condition.wait(lock);
+  }
+  else
+  {
+    {
+      std::lock_guard<std::mutex> lock(listenersMutex);
+      auto it = listeners.find(name);
+      if (it == listeners.end() || it->second.empty())
+        throw PipeConnectionError();
+
+      channel = it->second.front();
+      it->second.pop_front();
+      if (it->second.empty())
+        listeners.erase(it);
+    }
+    side = 1;
+
+    std::lock_guard<std::mutex> lock(channel->mutex);
+    channel->connected = true;
+    channel->condition.notify_all();
+  }
+}
+
+Communication::LoopbackTransport::~LoopbackTransport()
+{
+  Close();
+}
+
+void Communication::LoopbackTransport::ReadMessage(Communication::InputBuffer& message)
+{
+  std::unique_lock<std::mutex> lock(channel->mutex);
+  std::deque<std::vector<char> >& queue = channel->queues[side];
+  while (queue.empty() && !channel->closed[0] && !channel->closed[1])
+    channel->condition.wait(lock);
+
+  // Messages that arrived before the other end closed are still delivered
+  if (queue.empty() || channel->closed[side])
+    throw PipeDisconnectedError();
+
+  message.Clear();
+  GetData(message).swap(queue.front());
+  queue.pop_front();
+}
+
+void Communication::LoopbackTransport::WriteMessage(Communication::OutputBuffer& message)
+{
+  std::lock_guard<std::mutex> lock(channel->mutex);
+  if (channel->closed[0] || channel->closed[1])
+    throw PipeDisconnectedError();
+
+  // Copied, the caller may send or reuse the buffer again like with the
+  // other backends
+  channel->queues[1 - side].push_back(GetData(message));
+  channel->condition.notify_all();
+}
+
+void Communication::LoopbackTransport::Close()
+{
+  std::lock_guard<std::mutex> lock(channel->mutex);
+  channel->closed[side] = true;
+  channel->condition.notify_all();
+}
@@ -0,0 +1,48 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef LOOPBACK_TRANSPORT_H
+#define LOOPBACK_TRANSPORT_H
+
+#include <memory>
+
+#include "Communication.h"
+
+namespace Communication
+{
+  struct LoopbackChannel;
+
+  // In-process transport, mainly for tests and load generators. Like the
+  // other backends, WriteMessage() leaves the output buffer intact. Reading
+  // hands the data over without another copy.
+  class LoopbackTransport : public Transport
+  {
+  public:
+    LoopbackTransport(const std::wstring& name, Pipe::Mode mode);
+    ~LoopbackTransport();
+
+    void ReadMessage(InputBuffer& message);
+    void WriteMessage(OutputBuffer& message);
+    void Close();
+
+  private:
+    std::shared_ptr<LoopbackChannel> channel;
+    int side;
+  };
+}
+
+#endif
@@ -0,0 +1,51 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NAMED_PIPE_TRANSPORT_H
+#define NAMED_PIPE_TRANSPORT_H
+
+#include <Windows.h>
+
+#include "Communication.h"
+
+namespace Communication
+{
+  class NamedPipeTransport : public Transport
+  {
+  public:
+    NamedPipeTransport(const std::wstring& name, Pipe::Mode mode);
+    ~NamedPipeTransport();
+
+    void ReadMessage(InputBuffer& message);
+    void WriteMessage(OutputBuffer& message);
+    void Close();
+
+  private:
+    HANDLE pipe;
+    // The pipe is opened for overlapped I/O, otherwise Windows would
+    // serialize a pending read with writes from other threads.
+    HANDLE readEvent;
+    HANDLE writeEvent;
+    // Signalled by Close(), pending operations are then cancelled
+    HANDLE closeEvent;
+
+    DWORD Read(char* data, DWORD size, DWORD& bytesRead);
+    DWORD WaitForResult(OVERLAPPED& overlapped, DWORD& bytesTransferred);
+  };
+}
+
+#endif
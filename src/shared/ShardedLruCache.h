@@ -0,0 +1,180 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SHARDED_LRU_CACHE_H
+#define SHARDED_LRU_CACHE_H
+
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+// Thread-safe cache with a fixed capacity, split into shards with separate
+// locks so that threads rarely contend. Each shard evicts its least recently
+// used entry when full.
+//
+// Entries are tagged with the generation they were computed in. Invalidate()
+// starts a new generation, older entries are then ignored and dropped
+// lazily.
+template<class Key, class Value, class Hash = std::hash<Key> >
+class ShardedLruCache
+{
+public:
+  ShardedLruCache(size_t capacity, size_t shardCount = 16)
+    : shardCapacity((capacity + shardCount - 1) / shardCount), generation(0), hits(0), misses(0)
+  {
+    if (shardCapacity == 0)
+      shardCapacity = 1;
+    for (size_t i = 0; i < shardCount; i++)
+      shards.push_back(std::unique_ptr<Shard>(new Shard()));
+  }
+
+  bool Get(const Key& key, Value& value)
+  {
+    size_t hash = hasher(key);
+    Shard& shard = GetShard(hash);
+    uint32_t currentGeneration = generation;
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())
+    {
+      if (it->second->generation == currentGeneration)
+      {
+        // Move to the front, that's the most recently used end
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        value = it->second->value;
+        hits++;
+        return true;
+      }
+      shard.entries.erase(it->second);
+      shard.index.erase(it);
+    }
+    misses++;
+    return false;
+  }
+
+  void Put(const Key& key, const Value& value)
+  {
+    Put(key, value, generation);
+  }
+
+  // Only stores the value if no invalidation happened since entryGeneration
+  // was retrieved. Pass the result of GetGeneration() from before the value
+  // was computed, so that outdated results never end up in the cache.
+  void Put(const Key& key, const Value& value, uint32_t entryGeneration)
+  {
+    size_t hash = hasher(key);
+    Shard& shard = GetShard(hash);
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (entryGeneration != generation)
+      return;
+
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())
+    {
+      it->second->value = value;
+      it->second->generation = entryGeneration;
+      shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+      return;
+    }
+
+    if (shard.index.size() >= shardCapacity)
+    {
+      shard.index.erase(shard.entries.back().key);
+      shard.entries.pop_back();
+    }
+    shard.entries.push_front(Entry(key, value, entryGeneration));
+    shard.index[key] = shard.entries.begin();
+  }
+
+  void Invalidate()
+  {
+    generation++;
+  }
+
+  uint32_t GetGeneration() const
+  {
+    return generation;
+  }
+
+  size_t Size()
+  {
+    size_t size = 0;
+    for (size_t i = 0; i < shards.size(); i++)
+    {
+      std::lock_guard<std::mutex> lock(shards[i]->mutex);
+      size += shards[i]->index.size();
+    }
+    return size;
+  }
+
+  int64_t GetHits() const
+  {
+    return hits;
+  }
+
+  int64_t GetMisses() const
+  {
+    return misses;
+  }
+
+private:
+  struct Entry
+  {
+    Key key;
+    Value value;
+    uint32_t generation;
+
+    Entry(const Key& key, const Value& value, uint32_t generation)
+      : key(key), value(value), generation(generation)
+    {
+    }
+  };
+
+  typedef std::list<Entry> EntryList;
+
+  struct Shard
+  {
+    std::mutex mutex;
+    EntryList entries;
+    std::unordered_map<Key, typename EntryList::iterator, Hash> index;
+  };
+
+  Hash hasher;
+  std::vector<std::unique_ptr<Shard> > shards;
+  size_t shardCapacity;
+  std::atomic<uint32_t> generation;
+  std::atomic<int64_t> hits;
+  std::atomic<int64_t> misses;
+
+  Shard& GetShard(size_t hash)
+  {
+    // The map inside the shard uses the low bits already
+    return *shards[(hash >> (sizeof(size_t) * 4)) % shards.size()];
+  }
+
+  ShardedLruCache(const ShardedLruCache&);
+  ShardedLruCache& operator=(const ShardedLruCache&);
+};
+
+#endif
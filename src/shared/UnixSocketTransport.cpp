@@ -0,0 +1,221 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <errno.h>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "UnixSocketTransport.h"
+
+namespace
+{
+#ifdef MSG_NOSIGNAL
+  const int sendFlags = MSG_NOSIGNAL;
+#else
+  const int sendFlags = 0;
+#endif
+
+  // Far above the largest selector lists, a length prefix beyond this means
+  // the stream is corrupt
+  const uint32_t maxMessageSize = 64 * 1024 * 1024;
+
+  std::string AppendErrorCode(const std::string& message)
+  {
+    std::stringstream stream;
+    stream << message << " (Error code: " << errno << ")";
+    return stream.str();
+  }
+
+  std::wstring GetUserId()
+  {
+    std::wstringstream stream;
+    stream << getuid();
+    return stream.str();
+  }
+
+  // Socket paths are expected to be plain ASCII
+  bool ToSocketAddress(const std::wstring& name, sockaddr_un& address)
+  {
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (name.size() >= sizeof(address.sun_path))
+      return false;
+    for (size_t i = 0; i < name.size(); i++)
+      address.sun_path[i] = static_cast<char>(name[i]);
+    return true;
+  }
+
+  // Listening sockets are kept open for the lifetime of the process, every
+  // MODE_CREATE pipe accepts one connection on them - like a new named pipe
+  // instance would on Windows.
+  std::mutex listeningSocketsMutex;
+  std::map<std::wstring, int> listeningSockets;
+
+  int GetListeningSocket(const std::wstring& name)
+  {
+    std::lock_guard<std::mutex> lock(listeningSocketsMutex);
+    auto it = listeningSockets.find(name);
+    if (it != listeningSockets.end())
+      return it->second;
+
+    sockaddr_un address;
+    if (!ToSocketAddress(name, address))
+      throw std::runtime_error("Socket path is too long");
+
+    int listeningSocket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listeningSocket < 0)
+      throw std::runtime_error(AppendErrorCode("Failed to create socket"));
+
+    // Remove a stale socket file left behind by a previous instance
+    unlink(address.sun_path);
+    if (bind(listeningSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 ||
+        listen(listeningSocket, SOMAXCONN) < 0)
+    {
+      std::string message = AppendErrorCode("Failed to listen on socket");
+      close(listeningSocket);
+      throw std::runtime_error(message);
+    }
+
+    listeningSockets[name] = listeningSocket;
+    return listeningSocket;
+  }
+
+  // Returns false if the connection was closed before all data was read
+  bool ReadAll(int socket, char* data, size_t length)
+  {
+    while (length > 0)
+    {
+      ssize_t bytesRead = recv(socket, data, length, 0);
+      if (bytesRead == 0)
+        return false;
+      if (bytesRead < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        if (errno == ECONNRESET)
+          return false;
+        throw std::runtime_error(AppendErrorCode("Error reading from socket"));
+      }
+      data += bytesRead;
+      length -= bytesRead;
+    }
+    return true;
+  }
+
+  void WriteAll(int socket, const char* data, size_t length)
+  {
+    while (length > 0)
+    {
+      ssize_t bytesWritten = send(socket, data, length, sendFlags);
+      if (bytesWritten < 0)
+      {
+        if (errno == EINTR)
+          continue;
+        if (errno == EPIPE || errno == ECONNRESET)
+          throw Communication::PipeDisconnectedError();
+        throw std::runtime_error(AppendErrorCode("Failed to write to socket"));
+      }
+      data += bytesWritten;
+      length -= bytesWritten;
+    }
+  }
+}
+
+const std::wstring Communication::pipeName = L"/tmp/adblockplusengine_" + GetUserId();
+
+Communication::UnixSocketTransport::UnixSocketTransport(const std::wstring& name, Communication::Pipe::Mode mode)
+{
+  if (mode == Pipe::MODE_CREATE)
+  {
+    int listeningSocket = GetListeningSocket(name);
+    do
+      socket = accept(listeningSocket, 0, 0);
+    while (socket < 0 && errno == EINTR);
+
+    if (socket < 0)
+      throw std::runtime_error(AppendErrorCode("Client failed to connect"));
+  }
+  else
+  {
+    sockaddr_un address;
+    if (!ToSocketAddress(name, address))
+      throw PipeConnectionError();
+
+    socket = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (socket < 0)
+      throw std::runtime_error(AppendErrorCode("Failed to create socket"));
+
+    if (connect(socket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0)
+    {
+      PipeConnectionError error;
+      close(socket);
+      throw error;
+    }
+  }
+
+#ifdef SO_NOSIGPIPE
+  int noSigPipe = 1;
+  setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+}
+
+Communication::UnixSocketTransport::~UnixSocketTransport()
+{
+  close(socket);
+}
+
+void Communication::UnixSocketTransport::ReadMessage(Communication::InputBuffer& message)
+{
+  uint32_t length;
+  if (!ReadAll(socket, reinterpret_cast<char*>(&length), sizeof(length)))
+    throw PipeDisconnectedError();
+
+  if (length > maxMessageSize)
+  {
+    // The message boundaries are lost, the connection can't be used anymore
+    Close();
+    throw std::runtime_error("Message size exceeds the limit");
+  }
+
+  message.Clear();
+  std::vector<char>& buffer = GetData(message);
+  buffer.resize(length);
+  if (length && !ReadAll(socket, buffer.data(), length))
+    throw PipeDisconnectedError();
+}
+
+void Communication::UnixSocketTransport::WriteMessage(Communication::OutputBuffer& message)
+{
+  const std::vector<char>& data = GetData(message);
+  if (data.size() > maxMessageSize)
+    throw std::runtime_error("Message size exceeds the limit");
+
+  uint32_t length = static_cast<uint32_t>(data.size());
+  WriteAll(socket, reinterpret_cast<const char*>(&length), sizeof(length));
+  WriteAll(socket, data.data(), data.size());
+}
+
+void Communication::UnixSocketTransport::Close()
+{
+  // Unlike close(), this also wakes up threads blocked on the socket. The
+  // descriptor stays valid until the transport is destroyed.
+  shutdown(socket, SHUT_RDWR);
+}
@@ -0,0 +1,42 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef UNIX_SOCKET_TRANSPORT_H
+#define UNIX_SOCKET_TRANSPORT_H
+
+#include "Communication.h"
+
+namespace Communication
+{
+  // Stream socket transport, every message is preceded by its length to
+  // preserve message boundaries. The name is the path of the socket file.
+  class UnixSocketTransport : public Transport
+  {
+  public:
+    UnixSocketTransport(const std::wstring& name, Pipe::Mode mode);
+    ~UnixSocketTransport();
+
+    void ReadMessage(InputBuffer& message);
+    void WriteMessage(OutputBuffer& message);
+    void Close();
+
+  private:
+    int socket;
+  };
+}
+
+#endif
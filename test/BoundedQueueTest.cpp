@@ -0,0 +1,113 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../src/shared/BoundedQueue.h"
+
+TEST(BoundedQueueTest, FifoOrder)
+{
+  BoundedQueue<int> queue(3);
+  ASSERT_TRUE(queue.Push(1));
+  ASSERT_TRUE(queue.Push(2));
+  ASSERT_TRUE(queue.Push(3));
+  ASSERT_EQ(3u, queue.Size());
+
+  int value;
+  ASSERT_TRUE(queue.Pop(value));
+  ASSERT_EQ(1, value);
+  ASSERT_TRUE(queue.Pop(value));
+  ASSERT_EQ(2, value);
+  ASSERT_TRUE(queue.Pop(value));
+  ASSERT_EQ(3, value);
+  ASSERT_EQ(0u, queue.Size());
+}
+
+TEST(BoundedQueueTest, PushBlocksWhenFull)
+{
+  BoundedQueue<int> queue(1);
+  queue.Push(1);
+
+  std::atomic<bool> pushed(false);
+  std::thread producer([&queue, &pushed]()
+  {
+    queue.Push(2);
+    pushed = true;
+  });
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  ASSERT_FALSE(pushed);
+
+  int value;
+  queue.Pop(value);
+  producer.join();
+  ASSERT_TRUE(pushed);
+  ASSERT_EQ(1u, queue.Size());
+}
+
+TEST(BoundedQueueTest, Close)
+{
+  BoundedQueue<int> queue(2);
+  queue.Push(1);
+
+  std::thread consumer([&queue]()
+  {
+    int value;
+    while (queue.Pop(value))
+      ;
+  });
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  queue.Close();
+  consumer.join();
+
+  int value;
+  ASSERT_FALSE(queue.Pop(value));
+  ASSERT_FALSE(queue.Push(2));
+}
+
+TEST(BoundedQueueTest, MultipleProducers)
+{
+  const int producerCount = 4;
+  const int itemsPerProducer = 1000;
+  BoundedQueue<int> queue(16);
+
+  std::vector<std::thread> producers;
+  for (int i = 0; i < producerCount; i++)
+  {
+    producers.push_back(std::thread([&queue]()
+    {
+      for (int j = 1; j <= itemsPerProducer; j++)
+        queue.Push(int(j));
+    }));
+  }
+
+  int64_t sum = 0;
+  int value;
+  for (int i = 0; i < producerCount * itemsPerProducer; i++)
+  {
+    ASSERT_TRUE(queue.Pop(value));
+    sum += value;
+  }
+  for (size_t i = 0; i < producers.size(); i++)
+    producers[i].join();
+
+  ASSERT_EQ(int64_t(producerCount) * itemsPerProducer * (itemsPerProducer + 1) / 2, sum);
+}
@@ -0,0 +1,131 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../src/shared/Channel.h"
+
+namespace
+{
+  const std::wstring pipeName(L"adblockplustests_channel");
+  const int callCount = 8;
+
+  std::unique_ptr<Communication::Pipe> Connect()
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return std::unique_ptr<Communication::Pipe>(new Communication::Pipe(
+        pipeName, Communication::Pipe::MODE_CONNECT, Communication::Pipe::BACKEND_LOOPBACK));
+  }
+
+  // Waits for all calls to arrive before answering them in reverse order
+  void AnswerInReverse()
+  {
+    Communication::Pipe pipe(pipeName, Communication::Pipe::MODE_CREATE, Communication::Pipe::BACKEND_LOOPBACK);
+
+    std::vector<Communication::InputBuffer> requests(callCount);
+    for (int i = 0; i < callCount; i++)
+      pipe.ReadMessage(requests[i]);
+
+    for (int i = callCount - 1; i >= 0; i--)
+    {
+      int32_t value;
+      requests[i] >> value;
+
+      Communication::OutputBuffer response;
+      response << value * 2;
+      response.SetRequestId(requests[i].GetRequestId());
+      pipe.WriteMessage(response);
+    }
+  }
+
+  // Keeps the connection open until the other end closes it
+  void ReadUntilDisconnected()
+  {
+    Communication::Pipe pipe(pipeName, Communication::Pipe::MODE_CREATE, Communication::Pipe::BACKEND_LOOPBACK);
+    Communication::InputBuffer request;
+    try
+    {
+      for (;;)
+        pipe.ReadMessage(request);
+    }
+    catch (const Communication::PipeDisconnectedError&)
+    {
+    }
+  }
+
+  void AnswerNothing()
+  {
+    Communication::Pipe pipe(pipeName, Communication::Pipe::MODE_CREATE, Communication::Pipe::BACKEND_LOOPBACK);
+    Communication::InputBuffer request;
+    pipe.ReadMessage(request);
+  }
+}
+
+TEST(ChannelTest, ConcurrentCalls)
+{
+  std::thread server(AnswerInReverse);
+  Communication::Channel channel(Connect());
+
+  std::vector<int32_t> results(callCount);
+  std::vector<std::thread> clients;
+  for (int i = 0; i < callCount; i++)
+  {
+    clients.push_back(std::thread([&channel, &results, i]()
+    {
+      Communication::OutputBuffer request;
+      request << int32_t(i);
+      Communication::InputBuffer response;
+      channel.Call(request, response);
+      response >> results[i];
+    }));
+  }
+  for (size_t i = 0; i < clients.size(); i++)
+    clients[i].join();
+  server.join();
+
+  for (int i = 0; i < callCount; i++)
+    ASSERT_EQ(i * 2, results[i]);
+}
+
+TEST(ChannelTest, Disconnect)
+{
+  std::thread server(AnswerNothing);
+  Communication::Channel channel(Connect());
+
+  Communication::OutputBuffer request;
+  request << true;
+  Communication::InputBuffer response;
+  ASSERT_THROW(channel.Call(request, response), Communication::PipeDisconnectedError);
+  server.join();
+
+  ASSERT_FALSE(channel.IsConnected());
+  ASSERT_THROW(channel.Call(request, response), Communication::PipeDisconnectedError);
+}
+
+TEST(ChannelTest, CloseWhileConnected)
+{
+  std::thread server(ReadUntilDisconnected);
+  {
+    // The reader thread has to be stopped without the server's help
+    Communication::Channel channel(Connect());
+    ASSERT_TRUE(channel.IsConnected());
+  }
+  server.join();
+}
@@ -16,69 +16,105 @@
  */
 
 #include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#ifndef _WIN32
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 
-#include "../src/shared/AutoHandle.h"
 #include "../src/shared/Communication.h"
 
-const std::wstring pipeName(L"\\\\.\\pipe\\adblockplustests");
-
 namespace
 {
-  DWORD WINAPI CreatePipe(LPVOID param)
+  struct PipeBackend
   {
-    Communication::Pipe pipe(pipeName, Communication::Pipe::MODE_CREATE);
-    return 0;
-  }
+    Communication::Pipe::Backend backend;
+    const wchar_t* name;
+  };
 
-  DWORD WINAPI ReceiveSend(LPVOID param)
+  const PipeBackend backends[] = {
+#ifdef _WIN32
+    {Communication::Pipe::BACKEND_NAMED_PIPE, L"\\\\.\\pipe\\adblockplustests"},
+#else
+    {Communication::Pipe::BACKEND_UNIX_SOCKET, L"/tmp/adblockplustests"},
+#endif
+    {Communication::Pipe::BACKEND_LOOPBACK, L"adblockplustests"}
+  };
+
+  class CommunicationTest : public ::testing::TestWithParam<PipeBackend>
   {
-    Communication::Pipe pipe(pipeName, Communication::Pipe::MODE_CREATE);
+  protected:
+    void CreatePipe()
+    {
+      Communication::Pipe pipe(GetParam().name, Communication::Pipe::MODE_CREATE, GetParam().backend);
+    }
+
+    void ReceiveSend()
+    {
+      Communication::Pipe pipe(GetParam().name, Communication::Pipe::MODE_CREATE, GetParam().backend);
 
-    Communication::InputBuffer message = pipe.ReadMessage();
+      Communication::InputBuffer message = pipe.ReadMessage();
 
-    std::string stringValue;
-    std::wstring wstringValue;
-    int64_t int64Value;
-    int32_t int32Value;
-    bool boolValue;
-    message >> stringValue >> wstringValue >> int64Value >> int32Value >> boolValue;
+      std::string stringValue;
+      std::wstring wstringValue;
+      int64_t int64Value;
+      int32_t int32Value;
+      bool boolValue;
+      message >> stringValue >> wstringValue >> int64Value >> int32Value >> boolValue;
 
-    stringValue += " Received";
-    wstringValue += L" \u043f\u0440\u0438\u043d\u044f\u0442\u043e";
-    int64Value += 1;
-    int32Value += 2;
-    boolValue = !boolValue;
+      stringValue += " Received";
+      wstringValue += L" \u043f\u0440\u0438\u043d\u044f\u0442\u043e";
+      int64Value += 1;
+      int32Value += 2;
+      boolValue = !boolValue;
 
-    Communication::OutputBuffer response;
-    response << stringValue << wstringValue << int64Value << int32Value << boolValue;
-    pipe.WriteMessage(response);
+      Communication::OutputBuffer response;
+      response << stringValue << wstringValue << int64Value << int32Value << boolValue;
+      pipe.WriteMessage(response);
+    }
 
-    return 0;
+    std::unique_ptr<Communication::Pipe> Connect()
+    {
+      return std::unique_ptr<Communication::Pipe>(new Communication::Pipe(
+          GetParam().name, Communication::Pipe::MODE_CONNECT, GetParam().backend));
+    }
+  };
+
+  void Wait()
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
   }
 }
 
-TEST(CommunicationTest, ConnectPipe)
+INSTANTIATE_TEST_CASE_P(Backends, CommunicationTest, ::testing::ValuesIn(backends));
+
+TEST_P(CommunicationTest, ConnectPipe)
 {
-  AutoHandle thread(CreateThread(0, 0, CreatePipe, 0, 0, 0));
+  std::thread thread([this]() { CreatePipe(); });
 
-  Sleep(100);
+  Wait();
 
-  ASSERT_NO_THROW(Communication::Pipe pipe(pipeName, Communication::Pipe::MODE_CONNECT));
+  ASSERT_NO_THROW(Connect());
+  thread.join();
 }
 
-TEST(CommunicationTest, SendReceive)
+TEST_P(CommunicationTest, SendReceive)
 {
-  AutoHandle thread(CreateThread(0, 0, ReceiveSend, 0, 0, 0));
+  std::thread thread([this]() { ReceiveSend(); });
 
-  Sleep(100);
+  Wait();
 
-  Communication::Pipe pipe(pipeName, Communication::Pipe::MODE_CONNECT);
+  std::unique_ptr<Communication::Pipe> pipe = Connect();
 
   Communication::OutputBuffer message;
   message << std::string("Foo") << std::wstring(L"Bar") << int64_t(9876543210L) << int32_t(5) << true;
-  pipe.WriteMessage(message);
+  pipe->WriteMessage(message);
 
-  Communication::InputBuffer response = pipe.ReadMessage();
+  Communication::InputBuffer response = pipe->ReadMessage();
+  thread.join();
 
   std::string stringValue;
   std::wstring wstringValue;
@@ -112,3 +148,142 @@ TEST(CommunicationTest, SendReceive)
   ASSERT_EQ(7, int32Value);
   ASSERT_FALSE(boolValue);
 }
+
+TEST_P(CommunicationTest, DisconnectedPeer)
+{
+  std::thread thread([this]() { CreatePipe(); });
+
+  Wait();
+
+  std::unique_ptr<Communication::Pipe> pipe = Connect();
+  thread.join();
+
+  ASSERT_THROW(pipe->ReadMessage(), Communication::PipeDisconnectedError);
+}
+
+TEST_P(CommunicationTest, WriteKeepsMessage)
+{
+  std::vector<std::string> received;
+  std::thread thread([this, &received]()
+  {
+    Communication::Pipe pipe(GetParam().name, Communication::Pipe::MODE_CREATE, GetParam().backend);
+    for (int i = 0; i < 2; i++)
+    {
+      Communication::InputBuffer message = pipe.ReadMessage();
+      std::string value;
+      message >> value;
+      received.push_back(value);
+    }
+  });
+
+  Wait();
+
+  // All backends leave the written buffer intact, so it can be sent again
+  std::unique_ptr<Communication::Pipe> pipe = Connect();
+  Communication::OutputBuffer message;
+  message << std::string("Foo");
+  pipe->WriteMessage(message);
+  pipe->WriteMessage(message);
+  thread.join();
+
+  ASSERT_EQ(2u, received.size());
+  ASSERT_EQ("Foo", received[0]);
+  ASSERT_EQ("Foo", received[1]);
+}
+
+#ifndef _WIN32
+TEST(UnixSocketTransportTest, OversizedMessage)
+{
+  const std::wstring name(L"/tmp/adblockplustests_oversized");
+  std::thread thread([&name]()
+  {
+    Communication::Pipe pipe(name, Communication::Pipe::MODE_CREATE, Communication::Pipe::BACKEND_UNIX_SOCKET);
+    ASSERT_THROW(pipe.ReadMessage(), std::runtime_error);
+    // The connection is closed, the rest of the stream can't be parsed
+    ASSERT_THROW(pipe.ReadMessage(), Communication::PipeDisconnectedError);
+  });
+
+  Wait();
+
+  sockaddr_un address = {};
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, "/tmp/adblockplustests_oversized");
+  int client = socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT_EQ(0, connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+
+  // A corrupt length prefix, no data follows
+  uint32_t length = 0xFFFFFFFF;
+  ASSERT_EQ(static_cast<ssize_t>(sizeof(length)), send(client, &length, sizeof(length), 0));
+  thread.join();
+  close(client);
+}
+#endif
+
+TEST(CommunicationBufferTest, BorrowedStringRead)
+{
+  Communication::OutputBuffer message;
+  message << std::string("http://example.com/ad.png") << std::string("") << int32_t(5);
+
+  Communication::InputBuffer buffer(std::move(message));
+
+  Communication::StringRef url;
+  Communication::StringRef empty;
+  int32_t int32Value;
+  buffer >> url;
+  // Type and length of the empty string, type and value of the integer
+  ASSERT_EQ(16u, buffer.GetRemainingSize());
+  buffer >> empty >> int32Value;
+
+  ASSERT_EQ("http://example.com/ad.png", url.str());
+  ASSERT_EQ(0u, empty.length);
+  ASSERT_EQ(5, int32Value);
+  ASSERT_EQ(0u, buffer.GetRemainingSize());
+  ASSERT_ANY_THROW(buffer >> url);
+}
+
+TEST(CommunicationBufferTest, MoveBuffers)
+{
+  Communication::OutputBuffer message;
+  message << std::wstring(L"Foo") << true;
+
+  Communication::OutputBuffer movedMessage(std::move(message));
+  Communication::InputBuffer buffer(std::move(movedMessage));
+  Communication::InputBuffer movedBuffer;
+  movedBuffer = std::move(buffer);
+
+  std::wstring wstringValue;
+  bool boolValue;
+  movedBuffer >> wstringValue >> boolValue;
+  ASSERT_EQ(L"Foo", wstringValue);
+  ASSERT_TRUE(boolValue);
+  ASSERT_ANY_THROW(buffer >> wstringValue);
+}
+
+TEST(CommunicationBufferTest, AppendEncodedValues)
+{
+  Communication::OutputBuffer values;
+  values << int32_t(2) << std::string("foo") << std::string("bar");
+
+  Communication::OutputBuffer message;
+  message.SetRequestId(42);
+  message << true;
+  message.Append(values).Append(values);
+
+  Communication::InputBuffer buffer(std::move(message));
+  ASSERT_EQ(42u, buffer.GetRequestId());
+
+  bool boolValue;
+  buffer >> boolValue;
+  ASSERT_TRUE(boolValue);
+  for (int i = 0; i < 2; i++)
+  {
+    int32_t count;
+    std::string first;
+    std::string second;
+    buffer >> count >> first >> second;
+    ASSERT_EQ(2, count);
+    ASSERT_EQ("foo", first);
+    ASSERT_EQ("bar", second);
+  }
+  ASSERT_ANY_THROW(buffer >> boolValue);
+}
@@ -0,0 +1,110 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+
+#include "../src/engine/Executor.h"
+#include "../src/shared/Channel.h"
+
+namespace
+{
+  const std::wstring pipeName(L"adblockplustests_executor");
+
+  std::unique_ptr<Communication::Pipe> Connect()
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    return std::unique_ptr<Communication::Pipe>(new Communication::Pipe(
+        pipeName, Communication::Pipe::MODE_CONNECT, Communication::Pipe::BACKEND_LOOPBACK));
+  }
+
+  // Echoes the argument twice, PROC_MATCHES fails after writing it once
+  void HandleRequest(Communication::ProcType procedure, Communication::InputBuffer& request,
+      Communication::OutputBuffer& response)
+  {
+    int32_t value;
+    request >> value;
+    response << value;
+    if (procedure == Communication::PROC_MATCHES)
+      throw std::runtime_error("Handler failed");
+    response << value;
+  }
+
+  // Hands the requests of one connection to the executor, like the engine's
+  // client threads do
+  void Serve(Executor& executor)
+  {
+    std::shared_ptr<Connection> connection = std::make_shared<Connection>(
+        std::make_shared<Communication::Pipe>(pipeName, Communication::Pipe::MODE_CREATE,
+            Communication::Pipe::BACKEND_LOOPBACK));
+    try
+    {
+      for (;;)
+      {
+        Request request;
+        request.connection = connection;
+        connection->pipe->ReadMessage(request.message);
+        request.message >> request.procedure;
+        executor.Submit(std::move(request));
+      }
+    }
+    catch (const Communication::PipeDisconnectedError&)
+    {
+    }
+  }
+
+  void Call(Communication::Channel& channel, Communication::ProcType procedure,
+      Communication::InputBuffer& response)
+  {
+    Communication::OutputBuffer request;
+    request << procedure << int32_t(21);
+    channel.Call(request, response);
+  }
+}
+
+TEST(ExecutorTest, HandlerFailure)
+{
+  Executor executor("Test", 2, 4, HandleRequest);
+  std::thread server([&executor]()
+  {
+    Serve(executor);
+  });
+
+  {
+    Communication::Channel channel(Connect());
+
+    Communication::InputBuffer failed;
+    Call(channel, Communication::PROC_MATCHES, failed);
+    bool success;
+    failed >> success;
+    ASSERT_FALSE(success);
+    ASSERT_EQ(0u, failed.GetRemainingSize());
+
+    // The connection stays usable
+    Communication::InputBuffer response;
+    Call(channel, Communication::PROC_GET_PREF, response);
+    int32_t first;
+    int32_t second;
+    response >> success >> first >> second;
+    ASSERT_TRUE(success);
+    ASSERT_EQ(21, first);
+    ASSERT_EQ(21, second);
+  }
+  server.join();
+}
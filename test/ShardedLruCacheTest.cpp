@@ -0,0 +1,117 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../src/shared/ShardedLruCache.h"
+
+TEST(ShardedLruCacheTest, GetPut)
+{
+  ShardedLruCache<std::wstring, bool> cache(100);
+  bool value;
+  ASSERT_FALSE(cache.Get(L"foo", value));
+
+  cache.Put(L"foo", true);
+  cache.Put(L"bar", false);
+  ASSERT_TRUE(cache.Get(L"foo", value));
+  ASSERT_TRUE(value);
+  ASSERT_TRUE(cache.Get(L"bar", value));
+  ASSERT_FALSE(value);
+
+  cache.Put(L"foo", false);
+  ASSERT_TRUE(cache.Get(L"foo", value));
+  ASSERT_FALSE(value);
+  ASSERT_EQ(2u, cache.Size());
+
+  ASSERT_EQ(3, cache.GetHits());
+  ASSERT_EQ(1, cache.GetMisses());
+}
+
+TEST(ShardedLruCacheTest, EvictsLeastRecentlyUsed)
+{
+  ShardedLruCache<int, int> cache(3, 1);
+  cache.Put(1, 1);
+  cache.Put(2, 2);
+  cache.Put(3, 3);
+
+  int value;
+  ASSERT_TRUE(cache.Get(1, value));
+  cache.Put(4, 4);
+
+  ASSERT_EQ(3u, cache.Size());
+  ASSERT_FALSE(cache.Get(2, value));
+  ASSERT_TRUE(cache.Get(1, value));
+  ASSERT_TRUE(cache.Get(3, value));
+  ASSERT_TRUE(cache.Get(4, value));
+}
+
+TEST(ShardedLruCacheTest, Bounded)
+{
+  ShardedLruCache<int, int> cache(64, 4);
+  for (int i = 0; i < 1000; i++)
+    cache.Put(i, i);
+  ASSERT_LE(cache.Size(), 64u);
+}
+
+TEST(ShardedLruCacheTest, Invalidate)
+{
+  ShardedLruCache<int, int> cache(10);
+  cache.Put(1, 1);
+  uint32_t generation = cache.GetGeneration();
+
+  cache.Invalidate();
+  int value;
+  ASSERT_FALSE(cache.Get(1, value));
+  ASSERT_EQ(0u, cache.Size());
+
+  // A result computed before the invalidation must not be stored
+  cache.Put(2, 2, generation);
+  ASSERT_FALSE(cache.Get(2, value));
+
+  cache.Put(2, 2, cache.GetGeneration());
+  ASSERT_TRUE(cache.Get(2, value));
+  ASSERT_EQ(2, value);
+}
+
+TEST(ShardedLruCacheTest, ConcurrentAccess)
+{
+  ShardedLruCache<int, int> cache(256);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; i++)
+  {
+    threads.push_back(std::thread([&cache, i]()
+    {
+      for (int j = 0; j < 10000; j++)
+      {
+        int key = (j * 7 + i) % 512;
+        int value;
+        if (cache.Get(key, value))
+          ASSERT_EQ(key * 2, value);
+        else
+          cache.Put(key, key * 2);
+      }
+    }));
+  }
+  for (size_t i = 0; i < threads.size(); i++)
+    threads[i].join();
+
+  ASSERT_EQ(40000, cache.GetHits() + cache.GetMisses());
+  ASSERT_LE(cache.Size(), 256u);
+}
@@ -0,0 +1,79 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <iostream>
+#include <stdint.h>
+#include <string>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <chrono>
+#endif
+
+namespace Benchmark
+{
+  class Timer
+  {
+  public:
+    Timer()
+    {
+      Restart();
+    }
+
+    void Restart()
+    {
+#ifdef _WIN32
+      QueryPerformanceCounter(&start);
+#else
+      start = std::chrono::steady_clock::now();
+#endif
+    }
+
+    // Returns the seconds passed since construction or the last restart
+    double Elapsed() const
+    {
+#ifdef _WIN32
+      LARGE_INTEGER now;
+      LARGE_INTEGER frequency;
+      QueryPerformanceCounter(&now);
+      QueryPerformanceFrequency(&frequency);
+      return static_cast<double>(now.QuadPart - start.QuadPart) / frequency.QuadPart;
+#else
+      return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+#endif
+    }
+
+  private:
+#ifdef _WIN32
+    LARGE_INTEGER start;
+#else
+    std::chrono::steady_clock::time_point start;
+#endif
+  };
+
+  inline void Report(const std::string& name, int64_t iterations, double seconds)
+  {
+    std::cout << "[ BENCHMARK] " << name << ": " << iterations << " iterations in "
+              << seconds * 1000 << " ms (" << static_cast<int64_t>(iterations / seconds)
+              << "/s)" << std::endl;
+  }
+}
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <memory>
+
+#include "../../src/shared/Communication.h"
+#include "Benchmark.h"
+
+namespace
+{
+  const int iterations = 200000;
+  const std::string url("http://ads.example.com/banner/728x90.png?campaign=12345&slot=top");
+  const std::string type("IMAGE");
+  const std::string documentUrl("http://www.example.com/news/2015/03/some-article.html");
+
+  // The stream based buffers that Communication used before, kept here as a
+  // baseline. Only the parts needed for a PROC_MATCHES round trip are present.
+  class LegacyOutputBuffer
+  {
+  public:
+    std::string Get()
+    {
+      return buffer.str();
+    }
+
+    LegacyOutputBuffer& operator<<(Communication::ProcType value) { return Write(value, Communication::TYPE_PROC); }
+    LegacyOutputBuffer& operator<<(bool value) { return Write(value, Communication::TYPE_BOOL); }
+    LegacyOutputBuffer& operator<<(const std::string& value)
+    {
+      WriteBinary(Communication::TYPE_STRING);
+      Communication::SizeType length = static_cast<Communication::SizeType>(value.size());
+      WriteBinary(length);
+      buffer.write(value.c_str(), length);
+      return *this;
+    }
+
+  private:
+    std::ostringstream buffer;
+
+    template<class T>
+    LegacyOutputBuffer& Write(const T value, Communication::ValueType type)
+    {
+      WriteBinary(type);
+      WriteBinary(value);
+      return *this;
+    }
+
+    template<class T>
+    void WriteBinary(const T& value)
+    {
+      buffer.write(reinterpret_cast<const char*>(&value), sizeof(T));
+    }
+  };
+
+  class LegacyInputBuffer
+  {
+  public:
+    LegacyInputBuffer(const std::string& data) : buffer(data) {}
+
+    LegacyInputBuffer& operator>>(Communication::ProcType& value) { return Read(value); }
+    LegacyInputBuffer& operator>>(bool& value) { return Read(value); }
+    LegacyInputBuffer& operator>>(std::string& value)
+    {
+      Communication::ValueType type;
+      ReadBinary(type);
+      Communication::SizeType length;
+      ReadBinary(length);
+      std::unique_ptr<char[]> data(new char[length]);
+      buffer.read(data.get(), length);
+      value.assign(data.get(), length);
+      return *this;
+    }
+
+  private:
+    std::istringstream buffer;
+
+    template<class T>
+    LegacyInputBuffer& Read(T& value)
+    {
+      Communication::ValueType type;
+      ReadBinary(type);
+      ReadBinary(value);
+      return *this;
+    }
+
+    template<class T>
+    void ReadBinary(T& value)
+    {
+      buffer.read(reinterpret_cast<char*>(&value), sizeof(T));
+    }
+  };
+
+  std::string EncodeMatchesRequest()
+  {
+    LegacyOutputBuffer message;
+    message << Communication::PROC_MATCHES << url << type << documentUrl;
+    return message.Get();
+  }
+}
+
+TEST(CommunicationBenchmark, EncodeLegacy)
+{
+  size_t totalSize = 0;
+  Benchmark::Timer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    LegacyOutputBuffer message;
+    message << Communication::PROC_MATCHES << url << type << documentUrl;
+    totalSize += message.Get().size();
+  }
+  Benchmark::Report("Encode PROC_MATCHES (stream buffers)", iterations, timer.Elapsed());
+  ASSERT_GT(totalSize, 0u);
+}
+
+TEST(CommunicationBenchmark, Encode)
+{
+  // A new buffer per message, like the client does for every call
+  size_t totalSize = 0;
+  Benchmark::Timer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    Communication::OutputBuffer message;
+    message << Communication::PROC_MATCHES << url << type << documentUrl;
+    totalSize += Communication::InputBuffer(std::move(message)).GetRemainingSize();
+  }
+  Benchmark::Report("Encode PROC_MATCHES (contiguous buffers)", iterations, timer.Elapsed());
+  ASSERT_GT(totalSize, 0u);
+}
+
+TEST(CommunicationBenchmark, DecodeLegacy)
+{
+  const std::string data = EncodeMatchesRequest();
+  Communication::ProcType procedure;
+  std::string urlValue;
+  std::string typeValue;
+  std::string documentUrlValue;
+  Benchmark::Timer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    LegacyInputBuffer message(data);
+    message >> procedure >> urlValue >> typeValue >> documentUrlValue;
+  }
+  Benchmark::Report("Decode PROC_MATCHES (stream buffers)", iterations, timer.Elapsed());
+  ASSERT_EQ(url, urlValue);
+}
+
+TEST(CommunicationBenchmark, Decode)
+{
+  // Messages start with the request ID. The values are decoded into the same
+  // types as in the engine's PROC_MATCHES handler.
+  const std::string data = std::string(sizeof(Communication::RequestId), '\0') + EncodeMatchesRequest();
+  Communication::ProcType procedure;
+  std::string urlValue;
+  std::string typeValue;
+  std::string documentUrlValue;
+  Benchmark::Timer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    Communication::InputBuffer message(data);
+    message >> procedure >> urlValue >> typeValue >> documentUrlValue;
+  }
+  Benchmark::Report("Decode PROC_MATCHES (contiguous buffers)", iterations, timer.Elapsed());
+  ASSERT_EQ(url, urlValue);
+  ASSERT_EQ(documentUrl, documentUrlValue);
+}
@@ -0,0 +1,286 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <codecvt>
+#include <cstdlib>
+#include <fstream>
+#include <locale>
+#include <sstream>
+#include <stdexcept>
+
+#include "../../src/plugin/PluginFilterElementHide.h"
+#include "../../src/plugin/PluginStyleSheet.h"
+#include "../plugin/SyntheticDom.h"
+#include "Benchmark.h"
+
+// Replays recorded DOM dumps (see SyntheticDom.h for the format) against a
+// list of element hiding selectors. The inputs can be replaced through
+// environment variables:
+//
+//   ABP_BENCHMARK_DOM_DUMPS   semicolon separated list of DOM dumps
+//   ABP_BENCHMARK_SELECTORS   filter list, e.g. easylist.txt
+//
+// Only generic element hiding filters ("##selector") are taken from the
+// filter list, other lines are ignored.
+
+namespace
+{
+  const int iterations = 200;
+  const std::set<std::wstring> noExcludedSelectors;
+
+  std::string GetSetting(const char* name, const char* defaultValue)
+  {
+    const char* value = std::getenv(name);
+    return value && *value ? value : defaultValue;
+  }
+
+  std::wstring ReadFile(const std::string& path)
+  {
+    std::ifstream file(path.c_str(), std::ios_base::binary);
+    if (!file)
+    {
+      throw std::runtime_error("Can't read " + path);
+    }
+    std::ostringstream content;
+    content << file.rdbuf();
+    std::wstring_convert<std::codecvt_utf8<wchar_t> > converter;
+    return converter.from_bytes(content.str());
+  }
+
+  std::vector<std::string> Split(const std::string& str, char separator)
+  {
+    std::vector<std::string> parts;
+    std::istringstream stream(str);
+    std::string part;
+    while (std::getline(stream, part, separator))
+    {
+      if (!part.empty())
+      {
+        parts.push_back(part);
+      }
+    }
+    return parts;
+  }
+
+  // Returns the generic element hiding selectors of a filter list
+  std::vector<std::wstring> ReadSelectors(const std::string& path)
+  {
+    std::vector<std::wstring> selectors;
+    std::wistringstream filters(ReadFile(path));
+    std::wstring line;
+    while (std::getline(filters, line))
+    {
+      if (line.compare(0, 2, L"##") == 0)
+      {
+        selectors.push_back(line.substr(2, line.find_last_not_of(L" \t\r") - 1));
+      }
+    }
+    return selectors;
+  }
+
+  // The plugin skips selectors it can't parse as well
+  size_t AddSelectors(CElementHideMatcher& matcher, const std::vector<std::wstring>& selectors)
+  {
+    size_t added = 0;
+    for (size_t i = 0; i < selectors.size(); i++)
+    {
+      try
+      {
+        matcher.AddSelector(selectors[i]);
+        added++;
+      }
+      catch (const std::runtime_error&)
+      {
+      }
+    }
+    matcher.Build();
+    return added;
+  }
+
+  // Matches the children of the element and their descendants, keeping track
+  // of the ancestors the way the DOM traverser does
+  size_t MatchDescendants(const CElementHideMatcher& matcher, const SyntheticElement& parent, AncestorFilter& ancestors)
+  {
+    size_t hidden = 0;
+    const std::vector<SyntheticElement*>& children = parent.GetChildren();
+    for (size_t i = 0; i < children.size(); i++)
+    {
+      SyntheticElementView view(*children[i]);
+      ElementSnapshot element(view);
+      if (matcher.Match(element, noExcludedSelectors, &ancestors))
+      {
+        hidden++;
+      }
+      if (!children[i]->GetChildren().empty())
+      {
+        ancestors.PushElement(element.GetTagName(), element.GetId(), element.GetClassName());
+        hidden += MatchDescendants(matcher, *children[i], ancestors);
+        ancestors.PopElement();
+      }
+    }
+    return hidden;
+  }
+
+  class ElementHidingBenchmark : public ::testing::Test
+  {
+  protected:
+    std::vector<std::unique_ptr<SyntheticDocument> > documents;
+    // Elements of all documents in document order
+    std::vector<const SyntheticElement*> elements;
+    std::vector<std::wstring> selectors;
+
+    void SetUp()
+    {
+      std::vector<std::string> dumps = Split(GetSetting("ABP_BENCHMARK_DOM_DUMPS",
+        "test/benchmark/data/sample.dom"), ';');
+      for (std::vector<std::string>::const_iterator it = dumps.begin(); it != dumps.end(); ++it)
+      {
+        std::wistringstream dump(ReadFile(*it));
+        std::unique_ptr<SyntheticDocument> document(new SyntheticDocument());
+        document->Load(dump);
+        std::vector<const SyntheticElement*> documentElements = document->GetElements();
+        elements.insert(elements.end(), documentElements.begin(), documentElements.end());
+        documents.push_back(std::move(document));
+      }
+
+      selectors = ReadSelectors(GetSetting("ABP_BENCHMARK_SELECTORS", "test/benchmark/data/elemhide.txt"));
+    }
+  };
+}
+
+TEST_F(ElementHidingBenchmark, MatchDocuments)
+{
+  CElementHideMatcher matcher;
+  size_t selectorCount = AddSelectors(matcher, selectors);
+
+  size_t hidden = 0;
+  Benchmark::Timer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    for (size_t j = 0; j < elements.size(); j++)
+    {
+      SyntheticElementView element(*elements[j]);
+      if (matcher.Match(ElementSnapshot(element), noExcludedSelectors))
+      {
+        hidden++;
+      }
+    }
+  }
+  Benchmark::Report("Element hiding, elements matched", static_cast<int64_t>(iterations) * elements.size(), timer.Elapsed());
+  std::cout << "[ BENCHMARK] " << documents.size() << " documents, " << elements.size() << " elements, "
+            << selectorCount << " selectors, " << hidden / iterations << " elements hidden" << std::endl;
+  ASSERT_FALSE(elements.empty());
+}
+
+TEST_F(ElementHidingBenchmark, MatchDocumentsWithAncestorFilter)
+{
+  CElementHideMatcher matcher;
+  AddSelectors(matcher, selectors);
+
+  size_t hidden = 0;
+  Benchmark::Timer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    for (size_t j = 0; j < documents.size(); j++)
+    {
+      AncestorFilter ancestors;
+      hidden += MatchDescendants(matcher, documents[j]->GetRoot(), ancestors);
+    }
+  }
+  Benchmark::Report("Element hiding with ancestor filter, elements matched",
+    static_cast<int64_t>(iterations) * elements.size(), timer.Elapsed());
+  std::cout << "[ BENCHMARK] " << hidden / iterations << " elements hidden" << std::endl;
+}
+
+TEST_F(ElementHidingBenchmark, MatchDocumentsWithStyleSheets)
+{
+  CElementHideMatcher matcher;
+  size_t selectorCount = AddSelectors(matcher, selectors);
+
+  size_t hidden = 0;
+  size_t activeRules = 0;
+  size_t styleSheetRules = 0;
+  Benchmark::Timer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    for (size_t j = 0; j < documents.size(); j++)
+    {
+      // Includes generating the style sheets, the browser's own cascade isn't measured
+      std::vector<std::wstring> cssSelectors;
+      matcher.GetCssSelectors(noExcludedSelectors, cssSelectors);
+      std::vector<std::wstring> styleSheets = BuildHidingStyleSheets(cssSelectors);
+      styleSheetRules += cssSelectors.size();
+
+      std::vector<const SyntheticElement*> documentElements = documents[j]->GetElements();
+      CElementHideMatcher::ActiveRules rules;
+      matcher.KeepAll(rules, false);
+      activeRules += rules.GetSize();
+
+      for (size_t k = 0; k < documentElements.size(); k++)
+      {
+        SyntheticElementView element(*documentElements[k]);
+        if (matcher.Match(ElementSnapshot(element), noExcludedSelectors, 0, &rules))
+        {
+          hidden++;
+        }
+      }
+    }
+  }
+  Benchmark::Report("Element hiding with style sheets, elements matched",
+    static_cast<int64_t>(iterations) * elements.size(), timer.Elapsed());
+  std::cout << "[ BENCHMARK] " << styleSheetRules / iterations / documents.size() << " of " << selectorCount
+            << " selectors in style sheets, " << activeRules / iterations << " left for traversal, "
+            << hidden / iterations << " elements hidden by traversal" << std::endl;
+}
+
+TEST_F(ElementHidingBenchmark, LoadSelectors)
+{
+  Benchmark::Timer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    CElementHideMatcher matcher;
+    AddSelectors(matcher, selectors);
+  }
+  Benchmark::Report("Element hiding, selector lists loaded", iterations, timer.Elapsed());
+}
+
+TEST_F(ElementHidingBenchmark, LoadSelectorsInParallel)
+{
+  // A list the size of EasyList's hiding section, short lists are repeated
+  std::vector<std::wstring> list;
+  while (list.size() < 40000 && !selectors.empty())
+  {
+    list.insert(list.end(), selectors.begin(), selectors.end());
+  }
+
+  const int listIterations = 10;
+  const size_t threadCounts[] = {1, 2, 4, 8};
+  for (size_t i = 0; i < sizeof(threadCounts) / sizeof(threadCounts[0]); i++)
+  {
+    Benchmark::Timer timer;
+    for (int j = 0; j < listIterations; j++)
+    {
+      CElementHideMatcher matcher;
+      matcher.AddSelectors(list, threadCounts[i]);
+      matcher.Build();
+    }
+    Benchmark::Report("Element hiding, selectors compiled on " + std::to_string(static_cast<long long>(threadCounts[i])) +
+      " threads", static_cast<int64_t>(listIterations) * list.size(), timer.Elapsed());
+  }
+}
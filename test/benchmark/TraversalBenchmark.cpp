@@ -0,0 +1,180 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "../../src/plugin/PluginTreeWalker.h"
+#include "../plugin/SyntheticDom.h"
+#include "Benchmark.h"
+
+// Walks deeply nested synthetic documents, comparing the recursive traversal
+// the DOM traverser used to do with TreeWalker, and counts the heap
+// allocations per visited element.
+
+namespace
+{
+  int64_t allocations = 0;
+}
+
+// Counts every allocation of the benchmark binary
+void* operator new(size_t size)
+{
+  allocations++;
+  void* pointer = std::malloc(size ? size : 1);
+  if (!pointer)
+  {
+    throw std::bad_alloc();
+  }
+  return pointer;
+}
+
+void operator delete(void* pointer) throw()
+{
+  std::free(pointer);
+}
+
+void operator delete(void* pointer, size_t) throw()
+{
+  std::free(pointer);
+}
+
+namespace
+{
+  const int iterations = 20;
+  const size_t branches = 20;
+  const size_t depth = 1000;
+
+  struct Walk
+  {
+    int64_t elements;
+    int64_t allocations;
+  };
+
+  void Report(const std::string& name, const Walk& walk, double seconds)
+  {
+    Benchmark::Report(name + ", elements visited", walk.elements, seconds);
+    std::cout << "[ BENCHMARK] " << static_cast<double>(walk.allocations) / walk.elements
+              << " allocations per element" << std::endl;
+  }
+
+  // Counts the elements, like the traversal it keeps track of the indent
+  class SyntheticTree
+  {
+  public:
+    typedef const SyntheticElement* Node;
+    typedef const std::vector<SyntheticElement*>* Children;
+    typedef size_t State;
+
+    int64_t elements;
+
+    SyntheticTree() : elements(0)
+    {
+    }
+
+    bool Enter(const Node& node, const State&, size_t depth, Children& children, size_t& childCount, State& state)
+    {
+      elements++;
+      state = depth;
+      children = &node->GetChildren();
+      childCount = children->size();
+      return true;
+    }
+
+    void Leave(const Node&, const State&)
+    {
+    }
+
+    bool GetChild(const Children& children, size_t index, Node& child)
+    {
+      child = (*children)[index];
+      return true;
+    }
+  };
+
+  // What TraverseChild() used to do, minus the MSHTML calls
+  void TraverseChild(const SyntheticElement& element, const std::wstring& indent, int64_t& elements)
+  {
+    elements++;
+    const std::vector<SyntheticElement*>& children = element.GetChildren();
+    for (size_t i = 0; i < children.size(); i++)
+    {
+      TraverseChild(*children[i], indent + L"  ", elements);
+    }
+  }
+
+  class TraversalBenchmark : public ::testing::Test
+  {
+  protected:
+    SyntheticDocument document;
+
+    void SetUp()
+    {
+      SyntheticElement& body = *document.GetRoot().AppendChild(L"body");
+      for (size_t i = 0; i < branches; i++)
+      {
+        SyntheticElement* element = &body;
+        for (size_t j = 0; j < depth; j++)
+        {
+          element = element->AppendChild(L"div");
+        }
+      }
+    }
+
+    const SyntheticElement& GetBody()
+    {
+      return *document.GetRoot().GetChildren()[0];
+    }
+  };
+}
+
+TEST_F(TraversalBenchmark, RecursiveTraversal)
+{
+  Walk walk = {0, 0};
+  Benchmark::Timer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    int64_t allocationsBefore = allocations;
+    TraverseChild(GetBody(), L"", walk.elements);
+    walk.allocations += allocations - allocationsBefore;
+  }
+  Report("Recursive traversal", walk, timer.Elapsed());
+}
+
+TEST_F(TraversalBenchmark, TreeWalker)
+{
+  // Reused like the traverser's walker is for all documents of a tab
+  SyntheticTree tree;
+  TreeWalker<SyntheticTree> walker;
+  Walk walk = {0, 0};
+  Benchmark::Timer timer;
+  for (int i = 0; i < iterations; i++)
+  {
+    int64_t allocationsBefore = allocations;
+    walker.Start(tree, &GetBody(), 0);
+    while (walker.Step(tree))
+    {
+    }
+    walk.allocations += allocations - allocationsBefore;
+  }
+  walk.elements = tree.elements;
+  Report("Tree walker", walk, timer.Elapsed());
+}
@@ -0,0 +1,75 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <vector>
+
+#include "../../src/plugin/PluginElementIdentityTable.h"
+
+TEST(ElementIdentityTableTest, FindInsert)
+{
+  int elements[3];
+  ElementIdentityTable table;
+  ASSERT_EQ(-1, table.Find(&elements[0]));
+
+  table.Insert(&elements[0], 0);
+  table.Insert(&elements[1], 1);
+  ASSERT_EQ(0, table.Find(&elements[0]));
+  ASSERT_EQ(1, table.Find(&elements[1]));
+  ASSERT_EQ(-1, table.Find(&elements[2]));
+
+  table.Insert(&elements[0], 2);
+  ASSERT_EQ(2, table.Find(&elements[0]));
+  ASSERT_EQ(2u, table.GetSize());
+}
+
+TEST(ElementIdentityTableTest, Grow)
+{
+  std::vector<int> elements(5000);
+  ElementIdentityTable table;
+  for (size_t i = 0; i < elements.size(); i++)
+  {
+    table.Insert(&elements[i], static_cast<int>(i));
+  }
+  ASSERT_EQ(elements.size(), table.GetSize());
+  for (size_t i = 0; i < elements.size(); i++)
+  {
+    ASSERT_EQ(static_cast<int>(i), table.Find(&elements[i]));
+  }
+}
+
+TEST(ElementIdentityTableTest, Clear)
+{
+  std::vector<int> elements(100);
+  ElementIdentityTable table;
+  for (size_t i = 0; i < elements.size(); i++)
+  {
+    table.Insert(&elements[i], static_cast<int>(i));
+  }
+  table.Clear();
+  ASSERT_EQ(0u, table.GetSize());
+  for (size_t i = 0; i < elements.size(); i++)
+  {
+    ASSERT_EQ(-1, table.Find(&elements[i]));
+  }
+
+  // Slots of the previous generation are reused
+  table.Insert(&elements[50], 1);
+  ASSERT_EQ(1, table.Find(&elements[50]));
+  ASSERT_EQ(-1, table.Find(&elements[49]));
+  ASSERT_EQ(1u, table.GetSize());
+}
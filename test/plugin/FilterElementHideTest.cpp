@@ -0,0 +1,610 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <sstream>
+#include <stdexcept>
+#include "../../src/plugin/PluginFilterElementHide.h"
+#include "../../src/plugin/PluginStyleSheet.h"
+#include "SyntheticDom.h"
+
+namespace
+{
+  const std::set<std::wstring> noExcludedSelectors;
+
+  struct FetchCounts
+  {
+    FetchCounts() : tagName(0), id(0), className(0), style(0), attribute(0), parent(0), previousSibling(0)
+    {
+    }
+
+    int tagName;
+    int id;
+    int className;
+    int style;
+    int attribute;
+    int parent;
+    int previousSibling;
+  };
+
+  // Counts how often each property of the element and its relatives is fetched
+  class CountingElementView : public ElementView
+  {
+  public:
+    CountingElementView(const SyntheticElement& element, FetchCounts& counts)
+      : element(element), counts(counts)
+    {
+    }
+
+    std::wstring GetTagName() const
+    {
+      counts.tagName++;
+      return element.GetTagName();
+    }
+
+    std::wstring GetId() const
+    {
+      counts.id++;
+      return element.GetId();
+    }
+
+    std::wstring GetClassName() const
+    {
+      counts.className++;
+      return element.GetClassName();
+    }
+
+    bool GetStyle(std::wstring& cssText) const
+    {
+      counts.style++;
+      return element.GetStyle(cssText);
+    }
+
+    bool GetAttribute(const std::wstring& name, std::wstring& value) const
+    {
+      counts.attribute++;
+      return element.GetAttribute(name, value);
+    }
+
+    std::unique_ptr<ElementView> GetParent() const
+    {
+      counts.parent++;
+      return Wrap(element.GetParent());
+    }
+
+    std::unique_ptr<ElementView> GetPreviousSibling() const
+    {
+      counts.previousSibling++;
+      return Wrap(element.GetPreviousSibling());
+    }
+
+  private:
+    SyntheticElementView element;
+    FetchCounts& counts;
+
+    std::unique_ptr<ElementView> Wrap(std::unique_ptr<ElementView> view) const
+    {
+      if (!view)
+      {
+        return std::unique_ptr<ElementView>();
+      }
+      const SyntheticElement* relative = &static_cast<SyntheticElementView&>(*view).GetElement();
+      return std::unique_ptr<ElementView>(new CountingElementView(*relative, counts));
+    }
+  };
+
+  class ElementHideMatcherTest : public ::testing::Test
+  {
+  protected:
+    SyntheticDocument document;
+    CElementHideMatcher matcher;
+
+    void LoadDocument(const std::wstring& dump)
+    {
+      std::wistringstream stream(dump);
+      document.Load(stream);
+    }
+
+    void AddSelectors(const wchar_t* selectors[], size_t count)
+    {
+      for (size_t i = 0; i < count; i++)
+      {
+        matcher.AddSelector(selectors[i]);
+      }
+      matcher.Build();
+    }
+
+    // Returns the selector hiding the element with the given id. The ancestor
+    // filter is set up the way the DOM traverser does it unless disabled.
+    std::wstring MatchById(const std::wstring& id,
+      const std::set<std::wstring>& excludedSelectors = noExcludedSelectors, bool useAncestorFilter = true)
+    {
+      std::vector<const SyntheticElement*> elements = document.GetElements();
+      for (size_t i = 0; i < elements.size(); i++)
+      {
+        SyntheticElementView element(*elements[i]);
+        if (element.GetId() == id)
+        {
+          AncestorFilter ancestors;
+          for (std::unique_ptr<ElementView> parent = element.GetParent(); parent; parent = parent->GetParent())
+          {
+            ancestors.PushElement(parent->GetTagName(), parent->GetId(), parent->GetClassName());
+          }
+          const std::wstring* selector = matcher.Match(ElementSnapshot(element), excludedSelectors,
+            useAncestorFilter ? &ancestors : 0);
+          return selector ? *selector : std::wstring();
+        }
+      }
+      throw std::logic_error("No such element");
+    }
+  };
+}
+
+TEST(FilterElementHideTest, InvalidSelectors)
+{
+  ASSERT_THROW(CFilterElementHide(L""), std::runtime_error);
+  ASSERT_THROW(CFilterElementHide(L"%foo"), std::runtime_error);
+  ASSERT_THROW(CFilterElementHide(L"div[foo=\"bar\""), std::runtime_error);
+  ASSERT_THROW(CFilterElementHide(L"div[foo]bar"), std::runtime_error);
+  ASSERT_THROW(CFilterElementHide(L"div.ad..wide"), std::runtime_error);
+}
+
+TEST(FilterElementHideTest, ParseSelector)
+{
+  CFilterElementHide filter(L"DIV#banner.ad[style*=\"Display\"]");
+  ASSERT_EQ(L"div", filter.m_tag);
+  ASSERT_EQ(L"banner", filter.m_tagId);
+  ASSERT_EQ(1u, filter.m_tagClassNames.size());
+  ASSERT_EQ(L"ad", filter.m_tagClassNames[0]);
+  ASSERT_EQ(1u, filter.m_attributeSelectors.size());
+  ASSERT_EQ(STYLE, filter.m_attributeSelectors[0].m_type);
+  ASSERT_EQ(ANYWHERE, filter.m_attributeSelectors[0].m_pos);
+  ASSERT_EQ(L"display", filter.m_attributeSelectors[0].m_value);
+}
+
+TEST_F(ElementHideMatcherTest, IdClassAndTag)
+{
+  LoadDocument(
+    L"html\n"
+    L"  body\n"
+    L"    div id=\"banner\"\n"
+    L"    span id=\"sidebar\" class=\"box  sponsored\"\n"
+    L"    aside id=\"aside\"\n"
+    L"    p id=\"text\" class=\"box\"\n");
+  const wchar_t* selectors[] = {L"div#banner", L"#sidebar2", L".sponsored", L"aside"};
+  AddSelectors(selectors, sizeof(selectors) / sizeof(selectors[0]));
+
+  ASSERT_EQ(L"div#banner", MatchById(L"banner"));
+  ASSERT_EQ(L".sponsored", MatchById(L"sidebar"));
+  ASSERT_EQ(L"aside", MatchById(L"aside"));
+  ASSERT_EQ(L"", MatchById(L"text"));
+}
+
+TEST_F(ElementHideMatcherTest, Attributes)
+{
+  LoadDocument(
+    L"a id=\"exact\" href=\"http://ads.example.com/\"\n"
+    L"a id=\"starting\" href=\"http://ads.example.com/click\"\n"
+    L"a id=\"ending\" href=\"http://example.com/ad.js\"\n"
+    L"div id=\"style\" style=\"WIDTH: 728px; HEIGHT: 90px\"\n"
+    L"div id=\"none\" style=\"width: 100%\"\n");
+  const wchar_t* selectors[] = {
+    L"a[href=\"http://ads.example.com/\"]",
+    L"a[href^=\"http://ads.example.com/c\"]",
+    L"a[href$=\"/ad.js\"]",
+    L"div[style*=\"width: 728px\"]"
+  };
+  AddSelectors(selectors, sizeof(selectors) / sizeof(selectors[0]));
+
+  ASSERT_EQ(selectors[0], MatchById(L"exact"));
+  ASSERT_EQ(selectors[1], MatchById(L"starting"));
+  ASSERT_EQ(selectors[2], MatchById(L"ending"));
+  ASSERT_EQ(selectors[3], MatchById(L"style"));
+  ASSERT_EQ(L"", MatchById(L"none"));
+}
+
+TEST_F(ElementHideMatcherTest, Combinators)
+{
+  LoadDocument(
+    L"div id=\"ads\"\n"
+    L"  span id=\"child\"\n"
+    L"div id=\"other\"\n"
+    L"  span id=\"otherChild\"\n"
+    L"h2 id=\"heading\"\n"
+    L"p id=\"sibling\"\n"
+    L"p id=\"notSibling\"\n");
+  const wchar_t* selectors[] = {L"#ads > span", L"h2 + p"};
+  AddSelectors(selectors, sizeof(selectors) / sizeof(selectors[0]));
+
+  ASSERT_EQ(L"#ads > span", MatchById(L"child"));
+  ASSERT_EQ(L"", MatchById(L"otherChild"));
+  ASSERT_EQ(L"h2 + p", MatchById(L"sibling"));
+  ASSERT_EQ(L"", MatchById(L"notSibling"));
+  ASSERT_EQ(L"", MatchById(L"ads"));
+}
+
+TEST_F(ElementHideMatcherTest, DescendantCombinator)
+{
+  LoadDocument(
+    L"div id=\"page\" class=\"content\"\n"
+    L"  section id=\"main\"\n"
+    L"    ul id=\"list\"\n"
+    L"      li id=\"deep\"\n"
+    L"    h2 id=\"heading\"\n"
+    L"    p id=\"afterHeading\"\n"
+    L"  a id=\"link\" title=\"a > b + c\"\n"
+    L"span id=\"outside\"\n"
+    L"  li id=\"outsideItem\"\n");
+  const wchar_t* selectors[] = {
+    L".content  section li",
+    L"#page h2 + p",
+    L"div>section  >  ul",
+    L"#page a[title=\"a > b + c\"]",
+    L"span li li"
+  };
+  AddSelectors(selectors, sizeof(selectors) / sizeof(selectors[0]));
+
+  for (int useAncestorFilter = 0; useAncestorFilter < 2; useAncestorFilter++)
+  {
+    ASSERT_EQ(selectors[0], MatchById(L"deep", noExcludedSelectors, useAncestorFilter != 0));
+    ASSERT_EQ(L"", MatchById(L"outsideItem", noExcludedSelectors, useAncestorFilter != 0));
+    ASSERT_EQ(selectors[1], MatchById(L"afterHeading", noExcludedSelectors, useAncestorFilter != 0));
+    ASSERT_EQ(selectors[2], MatchById(L"list", noExcludedSelectors, useAncestorFilter != 0));
+    ASSERT_EQ(selectors[3], MatchById(L"link", noExcludedSelectors, useAncestorFilter != 0));
+    ASSERT_EQ(L"", MatchById(L"heading", noExcludedSelectors, useAncestorFilter != 0));
+  }
+
+  ASSERT_THROW(matcher.AddSelector(L"div >"), std::runtime_error);
+  ASSERT_THROW(matcher.AddSelector(L"div > + p"), std::runtime_error);
+}
+
+TEST(AncestorFilterTest, PushAndPop)
+{
+  AncestorFilter ancestors;
+  ancestors.PushElement(L"div", L"page", L"content  wide");
+  ancestors.PushElement(L"section", L"", L"");
+  ASSERT_TRUE(ancestors.MayContain(AncestorFilter::HashTag(L"div", 3)));
+  ASSERT_TRUE(ancestors.MayContain(AncestorFilter::HashId(L"page", 4)));
+  ASSERT_TRUE(ancestors.MayContain(AncestorFilter::HashClass(L"wide", 4)));
+  ASSERT_TRUE(ancestors.MayContain(AncestorFilter::HashTag(L"section", 7)));
+
+  ancestors.PopElement();
+  ASSERT_FALSE(ancestors.MayContain(AncestorFilter::HashTag(L"section", 7)));
+  ASSERT_TRUE(ancestors.MayContain(AncestorFilter::HashClass(L"content", 7)));
+
+  ancestors.PopElement();
+  ASSERT_FALSE(ancestors.MayContain(AncestorFilter::HashTag(L"div", 3)));
+  ASSERT_FALSE(ancestors.MayContain(AncestorFilter::HashId(L"page", 4)));
+  ASSERT_FALSE(ancestors.MayContain(AncestorFilter::HashClass(L"wide", 4)));
+}
+
+TEST_F(ElementHideMatcherTest, CompoundSelectors)
+{
+  LoadDocument(
+    L"div id=\"banner\" class=\"ad wide\"\n"
+    L"div id=\"banner2\" class=\"wide\"\n"
+    L"section id=\"outer\" class=\"sponsored box\"\n"
+    L"  span id=\"flagged\" class=\"label\" data-ad=\"\"\n"
+    L"  span id=\"plain\" class=\"label\"\n"
+    L"  span id=\"titled\" class=\"label\" title=\"Advertisement\"\n");
+  const wchar_t* selectors[] = {
+    L"div#banner.ad",
+    L"div#banner2.ad",
+    L"span[data-ad]",
+    L"section.sponsored > span.label[title$=\"ment\"]"
+  };
+  AddSelectors(selectors, sizeof(selectors) / sizeof(selectors[0]));
+
+  ASSERT_EQ(selectors[0], MatchById(L"banner"));
+  ASSERT_EQ(L"", MatchById(L"banner2"));
+  ASSERT_EQ(selectors[2], MatchById(L"flagged"));
+  ASSERT_EQ(L"", MatchById(L"plain"));
+  ASSERT_EQ(selectors[3], MatchById(L"titled"));
+}
+
+TEST_F(ElementHideMatcherTest, MultipleClasses)
+{
+  std::wstring manyClasses;
+  for (int i = 0; i < 40; i++)
+  {
+    manyClasses += L"box ";
+  }
+  LoadDocument(
+    L"div id=\"both\" class=\"wide ad\"\n"
+    L"div id=\"one\" class=\"ad\"\n"
+    L"div id=\"three\" class=\"ad sponsored wide\"\n"
+    L"p id=\"banner\" class=\"ad wide\"\n"
+    L"p id=\"outer\" class=\"sidebar promo\"\n"
+    L"  span id=\"inner\"\n"
+    L"span id=\"many\" class=\"" + manyClasses + L"ad wide\"\n");
+  const wchar_t* selectors[] = {
+    L"div.ad.wide",
+    L"div.ad.sponsored.wide",
+    L"#banner.wide.ad",
+    L".promo.sidebar > span",
+    L"span.wide.ad",
+    L".ad.banner",
+    L"div.box.never"
+  };
+  AddSelectors(selectors, sizeof(selectors) / sizeof(selectors[0]));
+
+  ASSERT_EQ(selectors[0], MatchById(L"both"));
+  ASSERT_EQ(L"", MatchById(L"one"));
+  ASSERT_NE(L"", MatchById(L"three"));
+  ASSERT_EQ(selectors[2], MatchById(L"banner"));
+  ASSERT_EQ(selectors[3], MatchById(L"inner"));
+  ASSERT_EQ(selectors[4], MatchById(L"many"));
+}
+
+TEST_F(ElementHideMatcherTest, CssSelectors)
+{
+  LoadDocument(
+    L"div id=\"banner\" class=\"ad\"\n"
+    L"div id=\"styled\" style=\"width: 728px\"\n");
+  const wchar_t* selectors[] = {
+    L"#banner",
+    L"div.ad > a[href^=\"http://ads.example.com/\"]",
+    L"div[style*=\"width: 728px\"]",
+    L"a[title=Some ad]",
+    L"#banner\\:ad"
+  };
+  AddSelectors(selectors, sizeof(selectors) / sizeof(selectors[0]));
+
+  std::set<std::wstring> excludedSelectors;
+  excludedSelectors.insert(L"#banner");
+  std::vector<std::wstring> cssSelectors;
+  matcher.GetCssSelectors(excludedSelectors, cssSelectors);
+  ASSERT_EQ(1u, cssSelectors.size());
+  ASSERT_EQ(selectors[1], cssSelectors[0]);
+
+  // Only the selectors CSS can't express are left for the traversal
+  CElementHideMatcher::ActiveRules rules;
+  matcher.KeepAll(rules, false);
+  ASSERT_EQ(3u, rules.GetSize());
+  SyntheticElementView styled(*document.GetElements()[1]);
+  const std::wstring* selector = matcher.Match(ElementSnapshot(styled), noExcludedSelectors, 0, &rules);
+  ASSERT_TRUE(selector);
+  ASSERT_EQ(selectors[2], *selector);
+  SyntheticElementView banner(*document.GetElements()[0]);
+  ASSERT_FALSE(matcher.Match(ElementSnapshot(banner), noExcludedSelectors, 0, &rules));
+}
+
+TEST_F(ElementHideMatcherTest, KeepAllRules)
+{
+  LoadDocument(
+    L"div id=\"banner\" class=\"ad\"\n"
+    L"div id=\"styled\" style=\"width: 728px\"\n");
+  const wchar_t* selectors[] = {
+    L"#banner",
+    L"div[style*=\"width: 728px\"]"
+  };
+  AddSelectors(selectors, sizeof(selectors) / sizeof(selectors[0]));
+
+  CElementHideMatcher::ActiveRules rules;
+  matcher.KeepAll(rules, false);
+  ASSERT_EQ(1u, rules.GetSize());
+  SyntheticElementView banner(*document.GetElements()[0]);
+  SyntheticElementView styled(*document.GetElements()[1]);
+  ASSERT_FALSE(matcher.Match(ElementSnapshot(banner), noExcludedSelectors, 0, &rules));
+  ASSERT_TRUE(matcher.Match(ElementSnapshot(styled), noExcludedSelectors, 0, &rules));
+
+  // Rules kept before the matcher changed aren't used
+  matcher.AddSelector(L"#styled");
+  matcher.Build();
+  ASSERT_TRUE(matcher.Match(ElementSnapshot(banner), noExcludedSelectors, 0, &rules));
+
+  matcher.KeepAll(rules, false);
+  matcher.Clear();
+  ASSERT_FALSE(matcher.Match(ElementSnapshot(styled), noExcludedSelectors, 0, &rules));
+
+  matcher.KeepAll(rules);
+  ASSERT_EQ(0u, rules.GetSize());
+  ASSERT_FALSE(matcher.Match(ElementSnapshot(banner), noExcludedSelectors, 0, &rules));
+}
+
+TEST(StyleSheetTest, BuildHidingStyleSheets)
+{
+  std::vector<std::wstring> selectors;
+  selectors.push_back(L"#ad");
+  selectors.push_back(L".banner");
+  selectors.push_back(L"div > a");
+
+  std::vector<std::wstring> styleSheets = BuildHidingStyleSheets(selectors, 2);
+  ASSERT_EQ(2u, styleSheets.size());
+  ASSERT_EQ(L"#ad { display: none !important; }\n.banner { display: none !important; }\n", styleSheets[0]);
+  ASSERT_EQ(L"div > a { display: none !important; }\n", styleSheets[1]);
+
+  ASSERT_EQ(1u, BuildHidingStyleSheets(selectors).size());
+  ASSERT_TRUE(BuildHidingStyleSheets(std::vector<std::wstring>()).empty());
+}
+
+TEST_F(ElementHideMatcherTest, ExcludedSelectors)
+{
+  LoadDocument(L"div id=\"banner\" class=\"ad\"\n");
+  const wchar_t* selectors[] = {L"#banner", L".ad"};
+  AddSelectors(selectors, sizeof(selectors) / sizeof(selectors[0]));
+
+  std::set<std::wstring> excludedSelectors;
+  excludedSelectors.insert(L"#banner");
+  ASSERT_EQ(L".ad", MatchById(L"banner", excludedSelectors));
+  excludedSelectors.insert(L".ad");
+  ASSERT_EQ(L"", MatchById(L"banner", excludedSelectors));
+
+  matcher.Clear();
+  ASSERT_EQ(L"", MatchById(L"banner"));
+}
+
+TEST(SyntheticDomTest, InvalidDump)
+{
+  SyntheticDocument document;
+  std::wistringstream badIndentation(L"div\n    span\n");
+  ASSERT_THROW(document.Load(badIndentation), std::runtime_error);
+  std::wistringstream badAttribute(L"div id=\"foo\n");
+  ASSERT_THROW(document.Load(badAttribute), std::runtime_error);
+}
+
+TEST(SyntheticDomTest, DocumentOrder)
+{
+  SyntheticDocument document;
+  std::wistringstream dump(L"html\n  head\n  body class=\"a \\\"b\\\"\"\n    div\n");
+  document.Load(dump);
+  std::vector<const SyntheticElement*> elements = document.GetElements();
+  ASSERT_EQ(4u, elements.size());
+  ASSERT_EQ(L"html", elements[0]->GetTagName());
+  ASSERT_EQ(L"head", elements[1]->GetTagName());
+  ASSERT_EQ(L"body", elements[2]->GetTagName());
+  ASSERT_EQ(L"div", elements[3]->GetTagName());
+  ASSERT_EQ(L"a \"b\"", SyntheticElementView(*elements[2]).GetClassName());
+  ASSERT_FALSE(SyntheticElementView(*elements[0]).GetParent());
+  ASSERT_EQ(L"head", SyntheticElementView(*elements[2]).GetPreviousSibling()->GetTagName());
+}
+
+TEST_F(ElementHideMatcherTest, PropertiesAreFetchedOnce)
+{
+  LoadDocument(
+    L"div id=\"container\" class=\"wrapper\"\n"
+    L"  p id=\"intro\"\n"
+    L"  div id=\"banner\" class=\"ad wide\" style=\"width: 728px\" data-slot=\"top\"\n");
+  const wchar_t* selectors[] = {
+    L"div#banner[data-slot=\"bottom\"]",
+    L"#banner[style*=\"height\"]",
+    L".ad[data-slot=\"left\"]",
+    L".ad[style^=\"height\"]",
+    L"div.ad[class$=\"narrow\"]",
+    L"#other > .ad",
+    L".narrow > .ad",
+    L"p.outro + .ad",
+    L"h2 + .ad",
+    L"#outro + div.wide",
+    L"div[data-slot=\"none\"]"
+  };
+  AddSelectors(selectors, sizeof(selectors) / sizeof(selectors[0]));
+
+  const SyntheticElement* banner = document.GetElements()[2];
+  FetchCounts counts;
+  CountingElementView element(*banner, counts);
+  ASSERT_FALSE(matcher.Match(ElementSnapshot(element), noExcludedSelectors));
+
+  // Own properties plus those of the parent and the previous sibling
+  ASSERT_EQ(2, counts.tagName);
+  ASSERT_EQ(3, counts.id);
+  ASSERT_EQ(3, counts.className);
+  ASSERT_EQ(1, counts.style);
+  ASSERT_EQ(1, counts.attribute);
+  ASSERT_EQ(1, counts.parent);
+  ASSERT_EQ(1, counts.previousSibling);
+}
+
+TEST_F(ElementHideMatcherTest, AncestorFilterAvoidsWalkingUp)
+{
+  LoadDocument(
+    L"div id=\"container\" class=\"wrapper\"\n"
+    L"  div id=\"inner\"\n"
+    L"    span id=\"label\" class=\"ad\"\n");
+  const wchar_t* selectors[] = {L"#sidebar .ad", L"aside > span.ad", L".wrapper .ad"};
+  AddSelectors(selectors, sizeof(selectors) / sizeof(selectors[0]));
+
+  const SyntheticElement* label = document.GetElements()[2];
+  AncestorFilter ancestors;
+  ancestors.PushElement(L"div", L"container", L"wrapper");
+  ancestors.PushElement(L"div", L"inner", L"");
+
+  FetchCounts counts;
+  CountingElementView element(*label, counts);
+  const std::wstring* selector = matcher.Match(ElementSnapshot(element), noExcludedSelectors, &ancestors);
+  ASSERT_TRUE(selector);
+  ASSERT_EQ(selectors[2], *selector);
+  // Only the matching selector walks up the tree
+  ASSERT_EQ(2, counts.parent);
+
+  ancestors.PopElement();
+  ancestors.PopElement();
+  counts = FetchCounts();
+  CountingElementView unrelated(*label, counts);
+  ASSERT_FALSE(matcher.Match(ElementSnapshot(unrelated), noExcludedSelectors, &ancestors));
+  ASSERT_EQ(0, counts.parent);
+}
+
+TEST(ElementHideMatcherMergeTest, AddSelectorsInParallel)
+{
+  // Enough selectors for several threads, some of them sharing keys, class
+  // names and attribute names across the parts
+  std::vector<std::wstring> selectors;
+  std::vector<std::wstring> invalidSelectors;
+  for (int i = 0; i < 5000; i++)
+  {
+    std::wstring n = std::to_wstring(static_cast<long long>(i / 8));
+    std::wstring shared = std::to_wstring(static_cast<long long>(i / 8 % 200));
+    switch (i % 8)
+    {
+    case 0: selectors.push_back(L"#ad" + n); break;
+    case 1: selectors.push_back(L"div.ad" + shared + L"[title]"); break;
+    case 2: selectors.push_back(L".wide.ad" + shared); break;
+    case 3: selectors.push_back(L"a[href^=\"http://ads" + n + L".\"]"); break;
+    case 4: selectors.push_back(L"div[data-ad" + std::to_wstring(static_cast<long long>(i % 5)) + L"]"); break;
+    case 5: selectors.push_back(L".box" + n + L" > span"); break;
+    case 6: selectors.push_back(L"#frame" + n + L" p.ad" + n); break;
+    default:
+      selectors.push_back(L"div.ad" + n + L"..wide");
+      invalidSelectors.push_back(selectors.back());
+      break;
+    }
+  }
+
+  std::wstring dump;
+  for (int i = 0; i < 625; i += 7)
+  {
+    std::wstring n = std::to_wstring(static_cast<long long>(i));
+    std::wstring shared = std::to_wstring(static_cast<long long>(i % 200));
+    dump += L"div id=\"ad" + n + L"\" class=\"wide ad" + shared + L" box" + n + L"\" title=\"x\"\n";
+    dump += L"  span\n";
+    dump += L"  a href=\"http://ads" + n + L".example.com/\"\n";
+    dump += L"div id=\"frame" + n + L"\" data-ad" + std::to_wstring(static_cast<long long>(i % 5)) + L"=\"1\"\n";
+    dump += L"  p class=\"ad" + n + L"\"\n";
+  }
+  SyntheticDocument document;
+  std::wistringstream stream(dump);
+  document.Load(stream);
+
+  CElementHideMatcher sequential;
+  std::vector<std::wstring> sequentialFailed = sequential.AddSelectors(selectors, 1);
+  sequential.Build();
+  CElementHideMatcher parallel;
+  std::vector<std::wstring> parallelFailed = parallel.AddSelectors(selectors, 4);
+  parallel.Build();
+  ASSERT_EQ(invalidSelectors, sequentialFailed);
+  ASSERT_EQ(invalidSelectors, parallelFailed);
+
+  size_t hidden = 0;
+  std::vector<const SyntheticElement*> elements = document.GetElements();
+  for (size_t i = 0; i < elements.size(); i++)
+  {
+    SyntheticElementView element(*elements[i]);
+    const std::wstring* expected = sequential.Match(ElementSnapshot(element), noExcludedSelectors);
+    const std::wstring* actual = parallel.Match(ElementSnapshot(element), noExcludedSelectors);
+    ASSERT_EQ(expected ? *expected : L"", actual ? *actual : L"");
+    hidden += expected ? 1 : 0;
+  }
+  ASSERT_EQ(elements.size(), hidden);
+
+  std::vector<std::wstring> expectedCssSelectors;
+  sequential.GetCssSelectors(noExcludedSelectors, expectedCssSelectors);
+  std::vector<std::wstring> cssSelectors;
+  parallel.GetCssSelectors(noExcludedSelectors, cssSelectors);
+  ASSERT_EQ(expectedCssSelectors, cssSelectors);
+}
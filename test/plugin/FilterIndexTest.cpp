@@ -0,0 +1,197 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include "../../src/plugin/PluginFilterIndex.h"
+
+namespace
+{
+  Atom Intern(AtomTable& atoms, const std::wstring& str)
+  {
+    return atoms.Intern(str.c_str(), str.size());
+  }
+
+  Atom Find(const AtomTable& atoms, const std::wstring& str)
+  {
+    return atoms.Find(str.c_str(), str.size());
+  }
+
+  std::vector<int> Values(const FilterIndex<int>& index, Atom tag, Atom name)
+  {
+    FilterIndex<int>::Range range = index.Find(tag, name);
+    return std::vector<int>(range.first, range.second);
+  }
+
+  bool HasTagOneAndNot40(Atom tag, Atom, int value)
+  {
+    return tag == 1 && value != 40;
+  }
+
+  void SwapTagAndName(Atom& tag, Atom& name, int& value)
+  {
+    std::swap(tag, name);
+    value++;
+  }
+}
+
+TEST(AtomTableTest, EmptyStringIsEmptyAtom)
+{
+  AtomTable atoms;
+  ASSERT_EQ(AtomTable::EMPTY_ATOM, Intern(atoms, L""));
+  ASSERT_EQ(AtomTable::EMPTY_ATOM, Find(atoms, L""));
+  ASSERT_EQ(0u, atoms.GetSize());
+}
+
+TEST(AtomTableTest, InternReturnsSameAtom)
+{
+  AtomTable atoms;
+  Atom foo = Intern(atoms, L"foo");
+  Atom bar = Intern(atoms, L"bar");
+  ASSERT_NE(foo, bar);
+  ASSERT_EQ(foo, Intern(atoms, L"foo"));
+  ASSERT_EQ(foo, Find(atoms, L"foo"));
+  ASSERT_EQ(bar, Find(atoms, L"bar"));
+  ASSERT_EQ(AtomTable::UNKNOWN_ATOM, Find(atoms, L"Foo"));
+  ASSERT_EQ(2u, atoms.GetSize());
+}
+
+TEST(AtomTableTest, FindSubstring)
+{
+  AtomTable atoms;
+  Atom ad = Intern(atoms, L"ad");
+  std::wstring classNames = L"ad banner";
+  ASSERT_EQ(ad, atoms.Find(classNames.c_str(), 2));
+  ASSERT_EQ(AtomTable::UNKNOWN_ATOM, atoms.Find(classNames.c_str() + 3, 6));
+}
+
+TEST(AtomTableTest, ManyAtoms)
+{
+  AtomTable atoms;
+  std::vector<Atom> interned;
+  for (int i = 0; i < 10000; i++)
+  {
+    interned.push_back(Intern(atoms, std::to_wstring(static_cast<long long>(i))));
+  }
+  for (int i = 0; i < 10000; i++)
+  {
+    ASSERT_EQ(interned[i], Find(atoms, std::to_wstring(static_cast<long long>(i))));
+  }
+  ASSERT_EQ(10000u, atoms.GetSize());
+
+  atoms.Clear();
+  ASSERT_EQ(AtomTable::UNKNOWN_ATOM, Find(atoms, L"1"));
+  ASSERT_EQ(0u, atoms.GetSize());
+}
+
+TEST(FilterIndexTest, FindKeepsInsertionOrder)
+{
+  FilterIndex<int> index;
+  index.Add(1, 2, 10);
+  index.Add(0, 2, 20);
+  index.Add(1, 2, 30);
+  index.Add(1, 0, 40);
+
+  ASSERT_TRUE(Values(index, 1, 2).empty());
+  index.Build();
+
+  std::vector<int> values = Values(index, 1, 2);
+  ASSERT_EQ(2u, values.size());
+  ASSERT_EQ(10, values[0]);
+  ASSERT_EQ(30, values[1]);
+  ASSERT_EQ(std::vector<int>(1, 20), Values(index, 0, 2));
+  ASSERT_EQ(std::vector<int>(1, 40), Values(index, 1, 0));
+  ASSERT_TRUE(Values(index, 2, 1).empty());
+  ASSERT_TRUE(Values(index, AtomTable::UNKNOWN_ATOM, 2).empty());
+  ASSERT_EQ(4u, index.GetSize());
+}
+
+TEST(FilterIndexTest, AddAfterBuild)
+{
+  FilterIndex<int> index;
+  index.Add(1, 1, 10);
+  index.Build();
+  index.Add(1, 1, 20);
+  index.Add(2, 1, 30);
+  index.Build();
+
+  std::vector<int> values = Values(index, 1, 1);
+  ASSERT_EQ(2u, values.size());
+  ASSERT_EQ(10, values[0]);
+  ASSERT_EQ(20, values[1]);
+  ASSERT_EQ(std::vector<int>(1, 30), Values(index, 2, 1));
+
+  index.Clear();
+  ASSERT_TRUE(Values(index, 1, 1).empty());
+  ASSERT_EQ(0u, index.GetSize());
+}
+
+TEST(FilterIndexTest, AddIf)
+{
+  FilterIndex<int> index;
+  index.Add(1, 1, 10);
+  index.Add(1, 2, 20);
+  index.Add(2, 1, 30);
+  index.Add(1, 1, 40);
+  index.Build();
+
+  FilterIndex<int> filtered;
+  filtered.AddIf(index, HasTagOneAndNot40);
+  filtered.Build();
+
+  ASSERT_EQ(std::vector<int>(1, 10), Values(filtered, 1, 1));
+  ASSERT_EQ(std::vector<int>(1, 20), Values(filtered, 1, 2));
+  ASSERT_TRUE(Values(filtered, 2, 1).empty());
+  ASSERT_EQ(2u, filtered.GetSize());
+}
+
+TEST(FilterIndexTest, AddMapped)
+{
+  FilterIndex<int> index;
+  index.Add(1, 2, 10);
+  index.Add(2, 1, 20);
+  index.Build();
+  index.Add(1, 2, 30);
+
+  // Both built and pending filters are taken over
+  FilterIndex<int> merged;
+  merged.Add(2, 1, 0);
+  merged.AddMapped(index, SwapTagAndName);
+  merged.Build();
+
+  std::vector<int> values = Values(merged, 2, 1);
+  ASSERT_EQ(3u, values.size());
+  ASSERT_EQ(0, values[0]);
+  ASSERT_EQ(11, values[1]);
+  ASSERT_EQ(31, values[2]);
+  ASSERT_EQ(std::vector<int>(1, 21), Values(merged, 1, 2));
+}
+
+TEST(FilterIndexTest, ManyKeys)
+{
+  FilterIndex<int> index;
+  for (int i = 0; i < 5000; i++)
+  {
+    index.Add(i % 7, i, i);
+  }
+  index.Build();
+  for (int i = 0; i < 5000; i++)
+  {
+    ASSERT_EQ(std::vector<int>(1, i), Values(index, i % 7, i));
+  }
+}
@@ -0,0 +1,60 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "../../src/plugin/PluginSlabArena.h"
+
+TEST(SlabArenaTest, AddIsPointerStable)
+{
+  SlabArena<int, 4> arena;
+  ASSERT_EQ(0u, arena.Add());
+  arena[0] = 42;
+  int* first = &arena[0];
+  for (int i = 1; i < 10; i++)
+  {
+    ASSERT_EQ(static_cast<size_t>(i), arena.Add());
+    arena[i] = i;
+  }
+  ASSERT_EQ(first, &arena[0]);
+  ASSERT_EQ(42, arena[0]);
+  ASSERT_EQ(9, arena[9]);
+  ASSERT_EQ(10u, arena.GetSize());
+  ASSERT_EQ(3 * 4 * sizeof(int), arena.GetResidentSize());
+}
+
+TEST(SlabArenaTest, ClearReusesAndReleasesSlabs)
+{
+  SlabArena<std::wstring, 4> arena(1);
+  for (int i = 0; i < 10; i++)
+  {
+    arena[arena.Add()] = L"element";
+  }
+  std::wstring* first = &arena[0];
+
+  // Only one slab stays on the free list
+  arena.Clear();
+  ASSERT_EQ(0u, arena.GetSize());
+  ASSERT_EQ(4 * sizeof(std::wstring), arena.GetResidentSize());
+
+  // Reused slabs hold default constructed elements
+  ASSERT_EQ(0u, arena.Add());
+  ASSERT_TRUE(arena[0].empty());
+  ASSERT_EQ(first, &arena[0]);
+  ASSERT_EQ(4 * sizeof(std::wstring), arena.GetResidentSize());
+}
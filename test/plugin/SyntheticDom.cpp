@@ -0,0 +1,234 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SyntheticDom.h"
+
+#include <algorithm>
+#include <cwctype>
+#include <stdexcept>
+
+namespace
+{
+  std::runtime_error DumpError(size_t lineNumber, const char* reason)
+  {
+    return std::runtime_error("Invalid DOM dump in line " + std::to_string(static_cast<unsigned long long>(lineNumber)) +
+      ": " + reason);
+  }
+
+  std::wstring ReadName(const std::wstring& line, size_t& pos)
+  {
+    size_t begin = pos;
+    while (pos < line.size() && line[pos] != L' ' && line[pos] != L'=')
+    {
+      pos++;
+    }
+    return line.substr(begin, pos - begin);
+  }
+}
+
+SyntheticElement::SyntheticElement(const std::wstring& tagName, SyntheticElement* parent)
+  : tagName(tagName), parent(parent)
+{
+}
+
+SyntheticElement::~SyntheticElement()
+{
+  for (std::vector<SyntheticElement*>::iterator it = children.begin(); it != children.end(); ++it)
+  {
+    delete *it;
+  }
+}
+
+SyntheticElement* SyntheticElement::GetPreviousSibling() const
+{
+  if (!parent)
+  {
+    return 0;
+  }
+  const std::vector<SyntheticElement*>& siblings = parent->children;
+  std::vector<SyntheticElement*>::const_iterator it = std::find(siblings.begin(), siblings.end(), this);
+  return it == siblings.begin() ? 0 : *(it - 1);
+}
+
+const std::wstring* SyntheticElement::FindAttribute(const std::wstring& name) const
+{
+  for (Attributes::const_iterator it = attributes.begin(); it != attributes.end(); ++it)
+  {
+    if (it->first == name)
+    {
+      return &it->second;
+    }
+  }
+  return 0;
+}
+
+void SyntheticElement::SetAttribute(const std::wstring& name, const std::wstring& value)
+{
+  for (Attributes::iterator it = attributes.begin(); it != attributes.end(); ++it)
+  {
+    if (it->first == name)
+    {
+      it->second = value;
+      return;
+    }
+  }
+  attributes.push_back(std::make_pair(name, value));
+}
+
+SyntheticElement* SyntheticElement::AppendChild(const std::wstring& tagName)
+{
+  std::unique_ptr<SyntheticElement> child(new SyntheticElement(tagName, this));
+  children.push_back(child.get());
+  return child.release();
+}
+
+SyntheticDocument::SyntheticDocument() : root(L"#document", 0)
+{
+}
+
+void SyntheticDocument::Load(std::wistream& dump)
+{
+  std::vector<SyntheticElement*> ancestors(1, &root);
+  std::wstring line;
+  for (size_t lineNumber = 1; std::getline(dump, line); lineNumber++)
+  {
+    if (!line.empty() && line[line.size() - 1] == L'\r')
+    {
+      line.erase(line.size() - 1);
+    }
+    size_t pos = line.find_first_not_of(L' ');
+    if (pos == std::wstring::npos)
+    {
+      continue;
+    }
+    if (pos % 2 != 0 || pos / 2 >= ancestors.size())
+    {
+      throw DumpError(lineNumber, "unexpected indentation");
+    }
+    ancestors.resize(pos / 2 + 1);
+
+    std::wstring tagName = ReadName(line, pos);
+    std::transform(tagName.begin(), tagName.end(), tagName.begin(), ::towlower);
+    SyntheticElement* element = ancestors.back()->AppendChild(tagName);
+    ancestors.push_back(element);
+
+    while (pos < line.size())
+    {
+      if (line[pos] == L' ')
+      {
+        pos++;
+        continue;
+      }
+      std::wstring name = ReadName(line, pos);
+      if (name.empty() || line.compare(pos, 2, L"=\"") != 0)
+      {
+        throw DumpError(lineNumber, "expected attribute");
+      }
+      pos += 2;
+      std::wstring value;
+      while (pos < line.size() && line[pos] != L'"')
+      {
+        if (line[pos] == L'\\' && pos + 1 < line.size())
+        {
+          pos++;
+        }
+        value += line[pos++];
+      }
+      if (pos == line.size())
+      {
+        throw DumpError(lineNumber, "unterminated attribute value");
+      }
+      pos++;
+      element->SetAttribute(name, value);
+    }
+  }
+}
+
+std::vector<const SyntheticElement*> SyntheticDocument::GetElements() const
+{
+  std::vector<const SyntheticElement*> elements;
+  std::vector<const SyntheticElement*> pending(1, &root);
+  while (!pending.empty())
+  {
+    const SyntheticElement* element = pending.back();
+    pending.pop_back();
+    if (element != &root)
+    {
+      elements.push_back(element);
+    }
+    const std::vector<SyntheticElement*>& children = element->GetChildren();
+    pending.insert(pending.end(), children.rbegin(), children.rend());
+  }
+  return elements;
+}
+
+SyntheticElementView::SyntheticElementView(const SyntheticElement& element) : element(element)
+{
+}
+
+std::wstring SyntheticElementView::GetTagName() const
+{
+  return element.GetTagName();
+}
+
+std::wstring SyntheticElementView::GetId() const
+{
+  const std::wstring* id = element.FindAttribute(L"id");
+  return id ? *id : std::wstring();
+}
+
+std::wstring SyntheticElementView::GetClassName() const
+{
+  const std::wstring* className = element.FindAttribute(L"class");
+  return className ? *className : std::wstring();
+}
+
+bool SyntheticElementView::GetStyle(std::wstring& cssText) const
+{
+  return GetAttribute(L"style", cssText);
+}
+
+bool SyntheticElementView::GetAttribute(const std::wstring& name, std::wstring& value) const
+{
+  const std::wstring* attribute = element.FindAttribute(name);
+  if (attribute)
+  {
+    value = *attribute;
+  }
+  return attribute != 0;
+}
+
+std::unique_ptr<ElementView> SyntheticElementView::GetParent() const
+{
+  // The document itself isn't an element
+  SyntheticElement* parent = element.GetParent();
+  if (!parent || !parent->GetParent())
+  {
+    return std::unique_ptr<ElementView>();
+  }
+  return std::unique_ptr<ElementView>(new SyntheticElementView(*parent));
+}
+
+std::unique_ptr<ElementView> SyntheticElementView::GetPreviousSibling() const
+{
+  SyntheticElement* sibling = element.GetPreviousSibling();
+  if (!sibling)
+  {
+    return std::unique_ptr<ElementView>();
+  }
+  return std::unique_ptr<ElementView>(new SyntheticElementView(*sibling));
+}
@@ -0,0 +1,121 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SYNTHETIC_DOM_H
+#define SYNTHETIC_DOM_H
+
+#include <istream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "../../src/plugin/PluginElementView.h"
+
+// In-memory DOM for running element hiding selectors without MSHTML.
+//
+// Documents are read from dumps with one element per line. Each line is
+// indented by two spaces per nesting level and holds the tag name followed by
+// the attributes, e.g.
+//
+//   div id="content" class="main wide"
+//     a href="http://example.com/" style="color: red;"
+//
+// Attribute values are double quoted, with backslash escaping '"' and '\'.
+class SyntheticElement
+{
+public:
+  typedef std::vector<std::pair<std::wstring, std::wstring> > Attributes;
+
+  SyntheticElement(const std::wstring& tagName, SyntheticElement* parent);
+
+  const std::wstring& GetTagName() const
+  {
+    return tagName;
+  }
+
+  SyntheticElement* GetParent() const
+  {
+    return parent;
+  }
+
+  SyntheticElement* GetPreviousSibling() const;
+  const std::vector<SyntheticElement*>& GetChildren() const
+  {
+    return children;
+  }
+
+  const std::wstring* FindAttribute(const std::wstring& name) const;
+  void SetAttribute(const std::wstring& name, const std::wstring& value);
+  SyntheticElement* AppendChild(const std::wstring& tagName);
+
+  ~SyntheticElement();
+
+private:
+  std::wstring tagName;
+  Attributes attributes;
+  SyntheticElement* parent;
+  std::vector<SyntheticElement*> children;
+
+  SyntheticElement(const SyntheticElement&);
+  SyntheticElement& operator=(const SyntheticElement&);
+};
+
+class SyntheticDocument
+{
+public:
+  SyntheticDocument();
+
+  // Throws std::runtime_error for malformed dumps
+  void Load(std::wistream& dump);
+
+  SyntheticElement& GetRoot()
+  {
+    return root;
+  }
+
+  // All elements below the root in document order
+  std::vector<const SyntheticElement*> GetElements() const;
+
+private:
+  SyntheticElement root;
+};
+
+class SyntheticElementView : public ElementView
+{
+public:
+  explicit SyntheticElementView(const SyntheticElement& element);
+
+  const SyntheticElement& GetElement() const
+  {
+    return element;
+  }
+
+  std::wstring GetTagName() const;
+  std::wstring GetId() const;
+  std::wstring GetClassName() const;
+  bool GetStyle(std::wstring& cssText) const;
+  bool GetAttribute(const std::wstring& name, std::wstring& value) const;
+
+  std::unique_ptr<ElementView> GetParent() const;
+  std::unique_ptr<ElementView> GetPreviousSibling() const;
+
+private:
+  const SyntheticElement& element;
+};
+
+#endif
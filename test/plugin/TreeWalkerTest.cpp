@@ -0,0 +1,150 @@
+/*
+ * This file is part of Adblock Plus <https://adblockplus.org/>,
+ * Copyright (C) 2006-2015 Eyeo GmbH
+ *
+ * Adblock Plus is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 3 as
+ * published by the Free Software Foundation.
+ *
+ * Adblock Plus is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Adblock Plus.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <gtest/gtest.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "../../src/plugin/PluginTreeWalker.h"
+#include "SyntheticDom.h"
+
+namespace
+{
+  // Records the callbacks, doesn't descend into elements with a skip attribute
+  class SyntheticTree
+  {
+  public:
+    typedef const SyntheticElement* Node;
+    typedef const std::vector<SyntheticElement*>* Children;
+    typedef size_t State;
+
+    std::vector<std::wstring> events;
+
+    bool Enter(const Node& node, const State&, size_t depth, Children& children, size_t& childCount, State& state)
+    {
+      events.push_back(L"+" + node->GetTagName());
+      state = depth;
+      if (node->FindAttribute(L"skip"))
+      {
+        return false;
+      }
+      children = &node->GetChildren();
+      childCount = children->size();
+      return true;
+    }
+
+    void Leave(const Node& node, const State&)
+    {
+      events.push_back(L"-" + node->GetTagName());
+    }
+
+    bool GetChild(const Children& children, size_t index, Node& child)
+    {
+      child = (*children)[index];
+      return true;
+    }
+  };
+
+  std::wstring Join(const std::vector<std::wstring>& events)
+  {
+    std::wstring result;
+    for (size_t i = 0; i < events.size(); i++)
+    {
+      result += (i ? L" " : L"") + events[i];
+    }
+    return result;
+  }
+
+  class TreeWalkerTest : public ::testing::Test
+  {
+  protected:
+    SyntheticDocument document;
+    SyntheticTree tree;
+    TreeWalker<SyntheticTree> walker;
+
+    void LoadDocument(const std::wstring& dump)
+    {
+      std::wistringstream stream(dump);
+      document.Load(stream);
+    }
+  };
+}
+
+TEST_F(TreeWalkerTest, DocumentOrder)
+{
+  LoadDocument(
+    L"body\n"
+    L"  div\n"
+    L"    a\n"
+    L"    b\n"
+    L"  p skip=\"\"\n"
+    L"    a\n"
+    L"  span\n");
+
+  walker.Start(tree, document.GetRoot().GetChildren()[0], 0);
+  while (walker.Step(tree))
+  {
+  }
+  ASSERT_TRUE(walker.IsDone());
+  // Leaving is only reported for elements the walk descended into
+  ASSERT_EQ(L"+body +div +a +b -div +p +span -body", Join(tree.events));
+}
+
+TEST_F(TreeWalkerTest, SuspendAndResume)
+{
+  LoadDocument(
+    L"body\n"
+    L"  div\n"
+    L"    a\n"
+    L"  span\n");
+
+  walker.Start(tree, document.GetRoot().GetChildren()[0], 0);
+  ASSERT_EQ(1u, walker.GetDepth());
+  ASSERT_TRUE(walker.Step(tree));
+  ASSERT_EQ(2u, walker.GetDepth());
+  ASSERT_EQ(1u, walker.GetState(1));
+  ASSERT_EQ(L"+body +div", Join(tree.events));
+
+  // Starting again abandons the walk in progress
+  tree.events.clear();
+  walker.Start(tree, document.GetRoot().GetChildren()[0], 0);
+  while (walker.Step(tree))
+  {
+  }
+  ASSERT_EQ(L"+body +div +a -div +span -body", Join(tree.events));
+}
+
+TEST_F(TreeWalkerTest, DeepNesting)
+{
+  const size_t depth = 10000;
+  SyntheticElement* element = &document.GetRoot();
+  for (size_t i = 0; i < depth; i++)
+  {
+    element = element->AppendChild(L"div");
+  }
+
+  walker.Start(tree, document.GetRoot().GetChildren()[0], 0);
+  size_t maxDepth = 0;
+  while (walker.Step(tree))
+  {
+    maxDepth = std::max(maxDepth, walker.GetDepth());
+  }
+  ASSERT_EQ(depth - 1, maxDepth);
+  ASSERT_EQ(2 * depth - 1, tree.events.size());
+}